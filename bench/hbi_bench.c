@@ -0,0 +1,459 @@
+/*******************************************************************************
+* Copyright (C) 2021 Microchip Technology Inc. and its subsidiaries.
+*
+* Subject to your compliance with these terms, you may use Microchip software
+* and any derivatives exclusively with Microchip products. It is your
+* responsibility to comply with third party license terms applicable to your
+* use of third party software (including open source software) that may
+* accompany Microchip software.
+*
+* THIS SOFTWARE IS SUPPLIED BY MICROCHIP "AS IS". NO WARRANTIES, WHETHER
+* EXPRESS, IMPLIED OR STATUTORY, APPLY TO THIS SOFTWARE, INCLUDING ANY IMPLIED
+* WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY, AND FITNESS FOR A
+* PARTICULAR PURPOSE.
+*
+* IN NO EVENT WILL MICROCHIP BE LIABLE FOR ANY INDIRECT, SPECIAL, PUNITIVE,
+* INCIDENTAL OR CONSEQUENTIAL LOSS, DAMAGE, COST OR EXPENSE OF ANY KIND
+* WHATSOEVER RELATED TO THE SOFTWARE, HOWEVER CAUSED, EVEN IF MICROCHIP HAS
+* BEEN ADVISED OF THE POSSIBILITY OR THE DAMAGES ARE FORESEEABLE. TO THE
+* FULLEST EXTENT ALLOWED BY LAW, MICROCHIP'S TOTAL LIABILITY ON ALL CLAIMS IN
+* ANY WAY RELATED TO THIS SOFTWARE WILL NOT EXCEED THE AMOUNT OF FEES, IF ANY,
+* THAT YOU HAVE PAID DIRECTLY TO MICROCHIP FOR THIS SOFTWARE.
+*******************************************************************************/
+
+/* Driver benchmark. Measures single register reads and writes, direct
+ * versus paged access, block throughput from 2 to 4096 bytes, host command
+ * round trip latency and a full image load, against the simulator (the
+ * default), SPI or I2C hardware. Results are printed as a table or, with
+ * -j, as one JSON object so runs before and after a change can be compared.
+ *
+ * On hardware the block tests overwrite configuration registers and the
+ * image load resets the device and overwrites its RAM, only run it on a
+ * board that is reloaded afterwards.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "hbi.h"
+
+#define BENCH_DEFAULT_MS             200
+#define BENCH_DEFAULT_SAMPLES        1000
+#define BENCH_DEFAULT_IMAGE_BYTES    (128 * 1024)
+
+/* page 255 base address, low word. Safe to rewrite, the window is only
+   used by the image load which sets it again */
+#define BENCH_REG_DIRECT             0x000E
+#define BENCH_REG_PAGED              0x0200
+#define BENCH_REG_PAGED_ALT          0x0300
+#define BENCH_REG_BLOCK              0x0200
+#define BENCH_REG_RESET              0x0014
+#define BENCH_REG_PAGE255_BASE       0x000C
+#define BENCH_REG_CMD_RESULT         0x0034
+#define BENCH_BOOT_ROM_SIGNATURE     0xD3D3
+#define BENCH_HOST_CMD_LOAD_CMP      0x000D
+#define BENCH_HOST_CMD_FWR_GO        0x0008
+#define BENCH_IMAGE_ADDR             0x00020000
+
+static const uint32_t benchBlockSize[] = { 2, 16, 64, 256, 1024, 4096 };
+
+static bool json;
+static bool firstResult = true;
+static uint64_t minNs = BENCH_DEFAULT_MS * 1000000ull;
+
+static uint64_t NowNs(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static int CompareU64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+/* start a result, as a JSON object in the results array or a table row */
+static void ResultBegin(const char *test, uint32_t size)
+{
+    if (json)
+    {
+        printf("%s    { \"test\": \"%s\"", firstResult ? "" : ",\n", test);
+        if (size)
+        {
+            printf(", \"size\": %u", size);
+        }
+    }
+    else
+    {
+        printf("%-24s", test);
+        if (size)
+        {
+            printf(" %6u B", size);
+        }
+        else
+        {
+            printf("         ");
+        }
+    }
+    firstResult = false;
+}
+
+static void ResultValue(const char *name, const char *unit, double value)
+{
+    if (json)
+    {
+        printf(", \"%s\": %.3f", name, value);
+    }
+    else
+    {
+        printf("  %10.2f %s", value, unit);
+    }
+}
+
+static void ResultEnd(bool ok)
+{
+    if (json)
+    {
+        printf(", \"ok\": %s }", ok ? "true" : "false");
+    }
+    else
+    {
+        printf("%s\n", ok ? "" : "  FAILED");
+    }
+}
+
+/* ops/s, time per op and, for data moving tests, throughput */
+static void ReportRate(const char *test, uint32_t size, uint64_t ops, uint64_t ns, bool ok)
+{
+    ResultBegin(test, size);
+    ResultValue("ops_per_sec", "ops/s", ops * 1e9 / ns);
+    ResultValue("us_per_op", "us", ns / 1e3 / ops);
+    if (size)
+    {
+        ResultValue("mb_per_sec", "MB/s", (double)ops * size * 1e3 / ns);
+    }
+    ResultEnd(ok);
+}
+
+static void ReportLatency(const char *test, uint64_t *pLat, uint32_t num, bool ok)
+{
+    qsort(pLat, num, sizeof(pLat[0]), CompareU64);
+    ResultBegin(test, 0);
+    ResultValue("p50_us", "us p50", pLat[num / 2] / 1e3);
+    ResultValue("p99_us", "us p99", pLat[(uint64_t)num * 99 / 100] / 1e3);
+    ResultValue("p999_us", "us p99.9", pLat[(uint64_t)num * 999 / 1000] / 1e3);
+    ResultValue("max_us", "us max", pLat[num - 1] / 1e3);
+    ResultEnd(ok);
+}
+
+/* single register reads, alternating between two registers if alt is set
+   so that every access of a paged register needs a page select */
+static void BenchRegRead(HbiDevice *pDev, const char *test, uint16_t reg, uint16_t alt)
+{
+    uint64_t start, ns, ops = 0;
+    uint16_t val;
+    bool ok = true;
+
+    start = NowNs();
+    do
+    {
+        ok &= (HbiRead(pDev, (ops & 1) ? alt : reg, (uint8_t *)&val, 2) == HBI_STATUS_SUCCESS);
+        ops++;
+        ns = NowNs() - start;
+    } while (ns < minNs);
+    ReportRate(test, 0, ops, ns, ok);
+}
+
+static void BenchRegWrite(HbiDevice *pDev, const char *test, uint16_t reg)
+{
+    uint64_t start, ns, ops = 0;
+    uint16_t val;
+    bool ok = true;
+
+    start = NowNs();
+    do
+    {
+        val = (uint16_t)ops;
+        ok &= (HbiWrite(pDev, reg, (uint8_t *)&val, 2) == HBI_STATUS_SUCCESS);
+        ops++;
+        ns = NowNs() - start;
+    } while (ns < minNs);
+    ReportRate(test, 0, ops, ns, ok);
+}
+
+static void BenchBlock(HbiDevice *pDev, uint8_t *buf, uint32_t size, bool write)
+{
+    uint64_t start, ns, ops = 0;
+    bool ok = true;
+
+    start = NowNs();
+    do
+    {
+        if (write)
+        {
+            ok &= (HbiWriteBlock(pDev, BENCH_REG_BLOCK, buf, size) == HBI_STATUS_SUCCESS);
+        }
+        else
+        {
+            ok &= (HbiReadBlock(pDev, BENCH_REG_BLOCK, buf, size) == HBI_STATUS_SUCCESS);
+        }
+        ops++;
+        ns = NowNs() - start;
+    } while (ns < minNs);
+    ReportRate(write ? "block_write" : "block_read", size, ops, ns, ok);
+}
+
+/* host command round trip, issue to result, with a command that has no
+   lasting effect */
+static void BenchHostCmd(HbiDevice *pDev, uint32_t samples)
+{
+    uint64_t *pLat;
+    uint64_t start;
+    uint32_t i;
+    bool ok = true;
+
+    pLat = malloc(samples * sizeof(uint64_t));
+    if (pLat == NULL)
+    {
+        return;
+    }
+    for (i = 0; i < samples; i++)
+    {
+        start = NowNs();
+        ok &= (HbiWriteHostCmd(pDev, HOST_CMD_HOST_FLASH_INIT) == HBI_STATUS_SUCCESS);
+        pLat[i] = NowNs() - start;
+    }
+    ReportLatency("host_cmd", pLat, samples, ok);
+    free(pLat);
+}
+
+/* add a frame header for size bytes at reg to an image block */
+static size_t ImageHdr(uint8_t *p, uint16_t reg, size_t size)
+{
+    uint16_t val;
+    size_t n = 0;
+
+    if (reg >> 8)
+    {
+        val = 0xFE00 | (((reg >> 8) != 0xFF) ? ((reg >> 8) - 1) : 0xFF);
+        p[n++] = val >> 8;
+        p[n++] = val & 0xFF;
+        val = ((reg & 0xFF) >> 1) << 8;
+    }
+    else
+    {
+        val = 0x8000 | (((reg & 0xFF) >> 1) << 8);
+    }
+    val |= 0x80 | ((size >> 1) - 1);
+    p[n++] = val >> 8;
+    p[n++] = val & 0xFF;
+    return n;
+}
+
+/* Load size bytes the way a firmware image is loaded: reset into the boot
+   ROM, then the image blocks, each setting the page 255 base address and
+   writing one page of RAM, queued as raw frames with as many blocks per bus
+   transaction as fit in a batch, then the load complete command. On the
+   simulator the loaded RAM is compared afterwards */
+static void BenchImageLoad(HbiDevice *pDev, uint32_t size, bool sim)
+{
+    const HbiPollCfg resetPollCfg = { 0, 100, 5000, 50 };
+    uint8_t (*block)[16 + 256];
+    uint8_t check[256];
+    HbiBatch batch = { 0 };
+    uint64_t start, ns;
+    uint32_t addr, i, n, b = 0;
+    uint16_t val;
+    size_t len;
+    bool ok = true;
+
+    start = NowNs();
+    HbiTransactionBegin(pDev);
+    val = 1;
+    HbiWrite(pDev, BENCH_REG_RESET, (uint8_t *)&val, 2);
+    HbiInvalidateCache(pDev);
+    if (HbiPollReg(pDev, BENCH_REG_CMD_RESULT, 0xFFFF, BENCH_BOOT_ROM_SIGNATURE, true,
+        &resetPollCfg, &val) != HBI_STATUS_SUCCESS)
+    {
+        ok = false;
+    }
+
+    /* the batch holds as many blocks as the bus limit allows */
+    ok = ok && (HbiBatchBegin(pDev, &batch) == HBI_STATUS_SUCCESS);
+    block = ok ? malloc((batch.maxFrames + 1) * sizeof(*block)) : NULL;
+    ok = ok && (block != NULL);
+    for (addr = BENCH_IMAGE_ADDR; ok && (addr < BENCH_IMAGE_ADDR + size); addr += 256)
+    {
+        len = ImageHdr(block[b], BENCH_REG_PAGE255_BASE, 4);
+        block[b][len++] = addr >> 24;
+        block[b][len++] = (addr >> 16) & 0xFF;
+        block[b][len++] = (addr >> 8) & 0xFF;
+        block[b][len++] = addr & 0xFF;
+        len += ImageHdr(&block[b][len], 0xFF00, 256);
+        for (i = 0; i < 256; i++)
+        {
+            block[b][len++] = (uint8_t)(addr + i * 7);
+        }
+        if (HbiBatchAppendRaw(&batch, block[b], len) == HBI_STATUS_RESOURCE_ERR)
+        {
+            /* batch full, send it and start the next one with this block */
+            ok = (HbiBatchSubmit(&batch) == HBI_STATUS_SUCCESS);
+            memcpy(block[0], block[b], len);
+            b = 0;
+            ok = ok && (HbiBatchAppendRaw(&batch, block[0], len) == HBI_STATUS_SUCCESS);
+        }
+        b++;
+    }
+    ok = ok && (HbiBatchSubmit(&batch) == HBI_STATUS_SUCCESS);
+    HbiBatchEnd(&batch);
+    free(block);
+
+    if (ok)
+    {
+        ok = (HbiWriteHostCmd(pDev, BENCH_HOST_CMD_LOAD_CMP) == HBI_STATUS_SUCCESS) &&
+            (HbiRead(pDev, BENCH_REG_CMD_RESULT, (uint8_t *)&val, 2) == HBI_STATUS_SUCCESS) &&
+            (val == HMI_RESP_SUCCESS);
+    }
+    ns = NowNs() - start;
+    /* back to a running application for whatever runs next */
+    HbiWriteHostCmd(pDev, BENCH_HOST_CMD_FWR_GO);
+    HbiTransactionEnd(pDev);
+
+    for (addr = BENCH_IMAGE_ADDR; sim && ok && (addr < BENCH_IMAGE_ADDR + size); addr += 256)
+    {
+        ok = (HbiSimReadMem(pDev, addr, check, sizeof(check)) == HBI_STATUS_SUCCESS);
+        for (n = 0; ok && (n < 256); n++)
+        {
+            ok = (check[n] == (uint8_t)(addr + n * 7));
+        }
+    }
+
+    ResultBegin("image_load", size);
+    ResultValue("ms", "ms", ns / 1e6);
+    ResultValue("kb_per_sec", "KB/s", size * 1e9 / 1024 / ns);
+    ResultEnd(ok);
+}
+
+static void Usage(const char *name)
+{
+    printf("Usage: %s [-d device|sim] [-c sim clock Hz] [-l sim command latency us] [-t ms per test]\n"
+        "          [-n host command samples] [-s image bytes] [-j]\n"
+        "  without -d the benchmark runs against the simulator\n", name);
+}
+
+int main(int argc, char** argv)
+{
+    HbiDevice *pDev;
+    HbiDeviceCfg cfg = { 0 };
+    HbiSimCfg simCfg = { 0 };
+    HbiStats stats;
+    uint8_t *buf;
+    uint32_t samples = BENCH_DEFAULT_SAMPLES, imageSize = BENCH_DEFAULT_IMAGE_BYTES;
+    uint32_t i;
+    bool sim;
+    int opt;
+
+    cfg.path = "sim";
+    while ((opt = getopt(argc, argv, "d:c:l:t:n:s:jh")) != -1)
+    {
+        switch (opt)
+        {
+            case 'd':
+                cfg.path = optarg;
+                break;
+            case 'c':
+                simCfg.speed = (uint32_t)strtoul(optarg, NULL, 0);
+                break;
+            case 'l':
+                simCfg.cmdLatencyUs = (uint32_t)strtoul(optarg, NULL, 0);
+                break;
+            case 't':
+                minNs = strtoull(optarg, NULL, 0) * 1000000ull;
+                break;
+            case 'n':
+                samples = (uint32_t)strtoul(optarg, NULL, 0);
+                break;
+            case 's':
+                /* whole pages of RAM */
+                imageSize = ((uint32_t)strtoul(optarg, NULL, 0) + 255) & ~255u;
+                break;
+            case 'j':
+                json = true;
+                break;
+            default:
+                Usage(argv[0]);
+                return (opt == 'h') ? 0 : -1;
+        }
+    }
+    if ((samples == 0) || (minNs == 0) || (imageSize == 0))
+    {
+        Usage(argv[0]);
+        return -1;
+    }
+
+    buf = malloc(benchBlockSize[sizeof(benchBlockSize) / sizeof(benchBlockSize[0]) - 1]);
+    if (buf == NULL)
+    {
+        printf("Error: out of memory\n");
+        return -1;
+    }
+    for (i = 0; i < benchBlockSize[sizeof(benchBlockSize) / sizeof(benchBlockSize[0]) - 1]; i++)
+    {
+        buf[i] = (uint8_t)i;
+    }
+
+    if (!HbiPortOpen(&pDev, &cfg))
+    {
+        printf("HbiPortOpen ERROR\n");
+        return -1;
+    }
+    sim = (HbiSimConfigure(pDev, &simCfg) == HBI_STATUS_SUCCESS);
+
+    if (json)
+    {
+        printf("{\n  \"device\": \"%s\",\n  \"ms_per_test\": %llu,\n  \"results\": [\n",
+            cfg.path, (unsigned long long)(minNs / 1000000));
+    }
+
+    BenchRegRead(pDev, "direct_read", BENCH_REG_DIRECT, BENCH_REG_DIRECT);
+    BenchRegWrite(pDev, "direct_write", BENCH_REG_DIRECT);
+    BenchRegRead(pDev, "paged_read_same_page", BENCH_REG_PAGED, BENCH_REG_PAGED);
+    BenchRegRead(pDev, "paged_read_page_switch", BENCH_REG_PAGED, BENCH_REG_PAGED_ALT);
+    for (i = 0; i < sizeof(benchBlockSize) / sizeof(benchBlockSize[0]); i++)
+    {
+        BenchBlock(pDev, buf, benchBlockSize[i], true);
+    }
+    for (i = 0; i < sizeof(benchBlockSize) / sizeof(benchBlockSize[0]); i++)
+    {
+        BenchBlock(pDev, buf, benchBlockSize[i], false);
+    }
+    BenchHostCmd(pDev, samples);
+    BenchImageLoad(pDev, imageSize, sim);
+
+    HbiStatsGet(pDev, &stats, false);
+    if (json)
+    {
+        printf("\n  ],\n  \"driver\": ");
+        HbiStatsDumpJson(&stats, stdout);
+        printf("}\n");
+    }
+    else
+    {
+        printf("bus: %llu transactions, %llu bytes, %.2f MB/s while busy\n",
+            (unsigned long long)stats.transactions,
+            (unsigned long long)(stats.txBytes + stats.rxBytes),
+            stats.busNs ? (stats.txBytes + stats.rxBytes) * 1e3 / stats.busNs : 0.0);
+    }
+
+    HbiPortClose(pDev);
+    free(buf);
+    return 0;
+}
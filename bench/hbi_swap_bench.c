@@ -0,0 +1,152 @@
+/*******************************************************************************
+* Copyright (C) 2021 Microchip Technology Inc. and its subsidiaries.
+*
+* Subject to your compliance with these terms, you may use Microchip software
+* and any derivatives exclusively with Microchip products. It is your
+* responsibility to comply with third party license terms applicable to your
+* use of third party software (including open source software) that may
+* accompany Microchip software.
+*
+* THIS SOFTWARE IS SUPPLIED BY MICROCHIP "AS IS". NO WARRANTIES, WHETHER
+* EXPRESS, IMPLIED OR STATUTORY, APPLY TO THIS SOFTWARE, INCLUDING ANY IMPLIED
+* WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY, AND FITNESS FOR A
+* PARTICULAR PURPOSE.
+*
+* IN NO EVENT WILL MICROCHIP BE LIABLE FOR ANY INDIRECT, SPECIAL, PUNITIVE,
+* INCIDENTAL OR CONSEQUENTIAL LOSS, DAMAGE, COST OR EXPENSE OF ANY KIND
+* WHATSOEVER RELATED TO THE SOFTWARE, HOWEVER CAUSED, EVEN IF MICROCHIP HAS
+* BEEN ADVISED OF THE POSSIBILITY OR THE DAMAGES ARE FORESEEABLE. TO THE
+* FULLEST EXTENT ALLOWED BY LAW, MICROCHIP'S TOTAL LIABILITY ON ALL CLAIMS IN
+* ANY WAY RELATED TO THIS SOFTWARE WILL NOT EXCEED THE AMOUNT OF FEES, IF ANY,
+* THAT YOU HAVE PAID DIRECTLY TO MICROCHIP FOR THIS SOFTWARE.
+*******************************************************************************/
+
+/* Microbenchmark of the host/device word order conversion: HbiConvertWords()
+ * against the per word HBI_VAL() loop it replaced, copying and in place, for
+ * buffer sizes from a register to a memory dump. Results are checked against
+ * the reference loop before timing.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "hbi.h"
+
+#define BENCH_MIN_NS                 200000000ull
+
+static const size_t benchSize[] = { 2, 16, 64, 256, 4096, 65536, 1048576 };
+
+static uint64_t NowNs(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+/* the conversion as done before HbiConvertWords() */
+static void RefConvert(uint16_t *dst, uint16_t const *src, size_t words)
+{
+    size_t i;
+    uint16_t temp;
+
+    for (i = 0; i < words; i++)
+    {
+        temp = src[i];
+        dst[i] = HBI_VAL(HBI_DEV_ENDIAN_BIG, temp);
+    }
+}
+
+/* ns per call of the reference (ref) or HbiConvertWords() */
+static double Measure(bool ref, uint16_t *dst, uint16_t const *src, size_t words)
+{
+    uint64_t start, elapsed;
+    uint64_t calls = 0, batch = 1;
+    uint64_t i;
+
+    start = NowNs();
+    do
+    {
+        for (i = 0; i < batch; i++)
+        {
+            if (ref)
+            {
+                RefConvert(dst, src, words);
+            }
+            else
+            {
+                HbiConvertWords(dst, src, words);
+            }
+            /* keep the compiler from dropping repeated conversions */
+            __asm__ __volatile__("" : : "r"(dst) : "memory");
+        }
+        calls += batch;
+        batch <<= 1;
+        elapsed = NowNs() - start;
+    } while (elapsed < BENCH_MIN_NS);
+
+    return (double)elapsed / calls;
+}
+
+int main(void)
+{
+    size_t maxSize = benchSize[sizeof(benchSize) / sizeof(benchSize[0]) - 1];
+    uint16_t *src, *dst, *ref;
+    double refNs, newNs, inNs;
+    size_t i, n, words;
+
+    /* one extra byte so the unaligned case stays inside the buffers */
+    src = malloc(maxSize + 2);
+    dst = malloc(maxSize + 2);
+    ref = malloc(maxSize + 2);
+    if ((src == NULL) || (dst == NULL) || (ref == NULL))
+    {
+        printf("Error: out of memory\n");
+        return -1;
+    }
+    for (i = 0; i < (maxSize >> 1) + 1; i++)
+    {
+        src[i] = (uint16_t)(i * 0x9E37 + 0x1234);
+    }
+
+    /* correctness first, including odd lengths and unaligned buffers */
+    for (words = 0; words < 200; words++)
+    {
+        RefConvert(ref, src, words);
+        HbiConvertWords((uint8_t *)dst + 1, src, words);
+        memmove(dst, (uint8_t *)dst + 1, words << 1);
+        if (memcmp(dst, ref, words << 1) != 0)
+        {
+            printf("Error: conversion of %u words differs from reference\n", (uint32_t)words);
+            return -1;
+        }
+        memcpy(dst, src, words << 1);
+        HbiConvertWords(dst, dst, words);
+        if (memcmp(dst, ref, words << 1) != 0)
+        {
+            printf("Error: in place conversion of %u words differs from reference\n",
+                (uint32_t)words);
+            return -1;
+        }
+    }
+
+    printf("host %s endian, device big endian\n", HOST_ENDIAN_LITTLE ? "little" : "big");
+    printf("%10s %14s %14s %14s %10s\n", "bytes", "HBI_VAL ns", "convert ns", "in place ns",
+        "GB/s");
+    for (n = 0; n < sizeof(benchSize) / sizeof(benchSize[0]); n++)
+    {
+        words = benchSize[n] >> 1;
+        refNs = Measure(true, dst, src, words);
+        newNs = Measure(false, dst, src, words);
+        inNs = Measure(false, dst, dst, words);
+        printf("%10u %14.1f %14.1f %14.1f %10.2f\n", (uint32_t)benchSize[n], refNs, newNs, inNs,
+            benchSize[n] / newNs);
+    }
+
+    free(src);
+    free(dst);
+    free(ref);
+    return 0;
+}
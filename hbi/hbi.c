@@ -23,18 +23,16 @@
 
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <sys/ioctl.h>
 #include <time.h>
-#include "hbi.h"
-//#define I2C //Enable for I2C data transfer
-#ifdef I2C
-#include <linux/i2c.h>
-#include <linux/i2c-dev.h>
-#else
-#include <linux/spi/spidev.h>
-#endif
+#include <errno.h>
+#include <poll.h>
+#include <linux/gpio.h>
+#include <string.h>
+#include "hbi_port.h"
 
 /**************************************************************/
 /* 			Hbi_frame_hdr() macro definition  				  */
@@ -50,265 +48,447 @@
     ((uint16_t)(HBI_DIRECT_READ(offset,length) | 0x0080))
 #define HBI_SELECT_PAGE(page) \
     ((uint16_t)(0xFE00 | (page)))	
+#define HBI_CONT_PAGED_WRITE(length) \
+    ((uint16_t)(0xFB00 | (length)))
 
-#define ZL380xx_MAX_ACCESS_SIZE_IN_BYTES       256 /*128 16-bit words*/
-#define TWOLF_MBCMDREG_SPINWAIT                10000
+/* a host command may take as long as 10000 polls at the former 10 ms interval */
+#define HBI_HOST_CMD_TIMEOUT_MS                100000
+/* with an event source, the command register is still checked this often in
+   case an interrupt edge is lost */
+#define HBI_EVENT_FALLBACK_MS                  100
 #define ZL380xx_HOST_SW_FLAGS_HOST_CMD         1
-#ifdef I2C
-char *i2c_fname = "/dev/i2c-1";
-#define I2C_SLAVE_ADDRESS 0x45
-#else
-static const char *device = "/dev/spidev0.0";
-static uint32_t mode;
-static uint8_t  bits = 8;
-static uint32_t speed = 20000000;//500000;
-#endif
-#ifdef I2C
-/********************************************************************/
-/* 	Open I2C device				 		                            */
-/* This example implementation is for user-mode linux. This 	    */
-/* code should be ported to the client's specific HW host mcu/mpu   */
-/********************************************************************/
-bool HbiPortOpen(int32_t *fd)
+#define HBI_DEFAULT_PATH                       "/dev/spidev0.0"
+#define HBI_DEFAULT_SPI_SPEED                  20000000 //500000
+#define HBI_DEFAULT_I2C_ADDR                   0x45
+
+/* per device locks, see struct HbiDevice for what they protect */
+static void HbiBusLock(HbiDevice *pDev)
+{
+    pthread_mutex_lock(&pDev->busLock);
+}
+
+static void HbiBusUnlock(HbiDevice *pDev)
 {
+    pthread_mutex_unlock(&pDev->busLock);
+}
 
-    int32_t ret_val;
-    int32_t handle = *fd;
+static bool HbiLockInit(HbiDevice *pDev)
+{
+    pthread_mutexattr_t attr;
+    bool ret = false;
 
-    /* Open the device node for the I2C bus 1 */
-    handle = open(i2c_fname, O_RDWR);
-    if (handle < 0)
+    if (pthread_mutexattr_init(&attr) != 0)
     {
-        printf("can't open device");
         return false;
     }
-    /* Set I2C_SLAVE */
-    ret_val = ioctl(handle, I2C_SLAVE, I2C_SLAVE_ADDRESS);
-    if (ret_val < 0)
+    if ((pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE) == 0) &&
+        (pthread_mutex_init(&pDev->cmdLock, &attr) == 0))
     {
-        printf("Could not set I2C_SLAVE.");
-        return false;
+        if (pthread_mutex_init(&pDev->busLock, &attr) == 0)
+        {
+            ret = true;
+        }
+        else
+        {
+            pthread_mutex_destroy(&pDev->cmdLock);
+        }
     }
-    *fd = handle;
-    return true;
+    pthread_mutexattr_destroy(&attr);
+    return ret;
+}
+
+static void HbiLockDestroy(HbiDevice *pDev)
+{
+    pthread_mutex_destroy(&pDev->busLock);
+    pthread_mutex_destroy(&pDev->cmdLock);
 }
-#else
+
+/* forget the page selected on the device, next paged access selects it again */
+static void HbiPageInvalidate(HbiDevice *pDev)
+{
+    pDev->page = 0;
+}
+
 /********************************************************************/
-/* 	Open SPI device				 		                            */
-/*	initialise SPI mode, bits. speed etc                            */
-/* This example implementation is for user-mode linux. This 	    */
-/* code should be ported to the client's specific HW host mcu/mpu   */
+/* 	Allocate a device handle and open its bus                       */
+/*	pCfg NULL opens the default bus with default settings, the      */
+/*	transport is picked from the device node unless given in pCfg   */
 /********************************************************************/
-
-bool HbiPortOpen(int32_t *fd)
+bool HbiPortOpen(HbiDevice **ppDev, HbiDeviceCfg const *pCfg)
 {
-    int32_t ret;
-    int32_t handle = *fd;
-    handle = open(device, O_RDWR);
-    if (handle < 0)
+    HbiDevice *pDev;
+    const char *capturePath;
+
+    if (ppDev == NULL)
     {
-        printf("can't open device");
         return false;
     }
-
-    /* 					 					 */
-    /*	initialise SPI mode, bits. speed etc */
-
-    /*
-    * spi mode
-    */
-    ret = ioctl(handle, SPI_IOC_WR_MODE, &mode);
-    if (ret == -1)
+    pDev = calloc(1, sizeof(HbiDevice));
+    if (pDev == NULL)
     {
-        printf("can't set spi mode");
+        printf("can't allocate device");
         return false;
     }
 
-    ret = ioctl(handle, SPI_IOC_RD_MODE, &mode);
-    if (ret == -1)
+    strncpy(pDev->path, (pCfg && pCfg->path) ? pCfg->path : HBI_DEFAULT_PATH,
+        sizeof(pDev->path) - 1);
+    if (pCfg && pCfg->pTransport)
     {
-        printf("can't get spi mode");
-        return false;
+        pDev->pTransport = pCfg->pTransport;
     }
-    /*
-    * bits per word
-    */
-    ret = ioctl(handle, SPI_IOC_WR_BITS_PER_WORD, &bits);
-    if (ret == -1)
+    else if (strncmp(pDev->path, "/dev/i2c", 8) == 0)
     {
-        printf("can't set bits per word");
-        return false;
+        pDev->pTransport = &hbiI2cTransport;
+    }
+    else if (strncmp(pDev->path, "sim", 3) == 0)
+    {
+        pDev->pTransport = &hbiSimTransport;
+    }
+    else
+    {
+        pDev->pTransport = &hbiSpiTransport;
     }
-    ret = ioctl(handle, SPI_IOC_RD_BITS_PER_WORD, &bits);
-    if (ret == -1)
+    pDev->fd = -1;
+    pDev->mode = pCfg ? pCfg->mode : 0;
+    pDev->bits = (pCfg && pCfg->bits) ? pCfg->bits : 8;
+    pDev->speed = (pCfg && pCfg->speed) ? pCfg->speed : HBI_DEFAULT_SPI_SPEED;
+    pDev->bulkSpeed = pCfg ? pCfg->bulkSpeed : 0;
+    pDev->i2cAddr = (pCfg && pCfg->i2cAddr) ? pCfg->i2cAddr : HBI_DEFAULT_I2C_ADDR;
+    pDev->maxMsg = pCfg ? pCfg->maxMsg : 0;
+
+    if (!HbiLockInit(pDev))
     {
-        printf("can't get bits per word");
+        printf("can't create device locks");
+        free(pDev);
         return false;
     }
-    /*
-    * max speed hz
-    */
-    ret = ioctl(handle, SPI_IOC_WR_MAX_SPEED_HZ, &speed);
-    if (ret == -1)
+    if (!pDev->pTransport->open(pDev))
     {
-        printf("can't set max speed hz");
+        HbiLockDestroy(pDev);
+        free(pDev);
         return false;
     }
-
-    ret = ioctl(handle, SPI_IOC_RD_MAX_SPEED_HZ, &speed);
-    if (ret == -1)
+    if (!HbiBufPoolInit(pDev, pCfg))
     {
-        printf("can't get max speed hz");
+        printf("can't allocate transfer buffers");
+        pDev->pTransport->close(pDev);
+        HbiLockDestroy(pDev);
+        free(pDev);
         return false;
     }
-    printf("spi mode: 0x%x\n", mode);
-    printf("bits per word: %u\n", bits);
-    printf("max speed: %u Hz (%u kHz)\n", (speed), (speed) / 1000);
 
-    *fd = handle;
+    capturePath = (pCfg && pCfg->capturePath) ? pCfg->capturePath : getenv("HBI_CAPTURE");
+    if (capturePath && (capturePath[0] != 0) &&
+        (HbiCaptureStart(pDev, capturePath) != HBI_STATUS_SUCCESS))
+    {
+        printf("can't create capture file %s\n", capturePath);
+    }
+    *ppDev = pDev;
     return true;
+}
 
+void HbiPortClose(HbiDevice *pDev)
+{
+    if (pDev)
+    {
+        pDev->pTransport->close(pDev);
+        free(pDev->pCache);
+        HbiTraceFree(pDev->pTrace);
+        HbiCaptureFree(pDev->pCapture);
+        HbiBufPoolFree(pDev);
+        HbiLockDestroy(pDev);
+        free(pDev);
+    }
 }
-#endif
-void HbiPortClose(int32_t fd)
+uint32_t HbiXferSpeed(HbiDevice *pDev, size_t len)
 {
-    close(fd);
+    return ((len >= HBI_BULK_MIN_BYTES) && pDev->bulkSpeed) ? pDev->bulkSpeed : pDev->speed;
 }
-#ifdef I2C
-/*********************************************************************************/
-/* 					Read from Device.							                 */
-/* This example implementation is for user-mode linux. This 	                 */
-/* code should be ported to the client's specific HW host mcu/mpu                */
-/*********************************************************************************/
-bool HbiPortRead(int32_t i2c_fd, void *pSrc, void *pDst, size_t nread, size_t nwrite)
+
+/* bytes a transfer of len bytes counts against the message limit of the bus */
+size_t HbiMsgLen(HbiDevice *pDev, size_t len)
 {
+    size_t align = pDev->msgAlign;
 
+    return (align > 1) ? ((len + align - 1) / align) * align : len;
+}
 
-    int ret_val;
-    struct i2c_msg msgs[2];
-    struct i2c_rdwr_ioctl_data msgset;
+/* count one bus transaction started at startNs, called with the bus lock
+   held. Returns the time it ended */
+static uint64_t HbiPortAccount(HbiDevice *pDev, uint64_t startNs, uint32_t frames, size_t ntx,
+    size_t nrx, bool ok)
+{
+    uint64_t end = HbiStatsNowNs();
 
-    msgs[0].addr = I2C_SLAVE_ADDRESS;
-    msgs[0].flags = 0;
-    msgs[0].len = nwrite;
-    msgs[0].buf = pSrc;
+    pDev->stats.transactions++;
+    pDev->stats.frames += frames;
+    pDev->stats.txBytes += ntx;
+    pDev->stats.rxBytes += nrx;
+    pDev->stats.busNs += end - startNs;
+    if (!ok)
+    {
+        pDev->stats.errors++;
+    }
+    return end;
+}
 
-    msgs[1].addr = I2C_SLAVE_ADDRESS;
-    msgs[1].flags = I2C_M_RD;
-    msgs[1].len = nread;
-    msgs[1].buf = pDst;
+/* split a read or write frame into payload and command overhead, called with
+   the bus lock held */
+static void HbiPortAccountFrame(HbiDevice *pDev, uint16_t reg_addr, size_t hdrLen, size_t size)
+{
+    pDev->stats.payloadBytes += size;
+    pDev->stats.overheadBytes += hdrLen;
+    if ((reg_addr >> 8) == 0)
+    {
+        return;
+    }
+    if (hdrLen == 4)
+    {
+        pDev->stats.pageSelects++;
+    }
+    else
+    {
+        pDev->stats.pageSelectsSaved++;
+    }
+}
 
-    msgset.msgs = msgs;
-    msgset.nmsgs = 2;
+/* true if frames of pDev are traced or captured, called with the bus lock held */
+static bool HbiPortTraced(HbiDevice *pDev)
+{
+    return (pDev->pTrace != NULL) || (pDev->pCapture != NULL);
+}
 
-    if (ioctl(i2c_fd, I2C_RDWR, &msgset) < 0) {
-        perror("ioctl(I2C_RDWR) in i2c_read");
-        return false;
+/* hand one frame to the trace ring and the capture file. first marks the
+   first frame of a bus transaction */
+static void HbiPortTrace(HbiDevice *pDev, bool first, uint64_t startNs, uint64_t endNs,
+    uint8_t flags, uint8_t const *tx, size_t ntx, uint8_t const *data, size_t ndata,
+    uint8_t const *rx, size_t nrx)
+{
+    if (pDev->pTrace)
+    {
+        HbiTraceFrame(pDev->pTrace, startNs, endNs, flags, tx, ntx, data, ndata, rx, nrx);
+    }
+    if (pDev->pCapture)
+    {
+        HbiCaptureFrame(pDev->pCapture, first, startNs, endNs, flags, tx, ntx, data, ndata, nrx);
     }
-    return true;
 }
-#else
+
 /*********************************************************************************/
 /* 					Read from Device.							                 */
-/* This example implementation is for user-mode linux. This 	                 */
-/* code should be ported to the client's specific HW host mcu/mpu                */
 /*********************************************************************************/
-bool HbiPortRead(int32_t fd, void *pSrc, void *pDst, size_t nread, size_t nwrite)
+bool HbiPortRead(HbiDevice *pDev, void *pSrc, void *pDst, size_t nread, size_t nwrite)
 {
-    int32_t ret = 0;
-    struct spi_ioc_transfer xfer[2] = { 0 };
+    uint64_t start, end;
+    bool ret;
 
-    xfer[0].tx_buf = (unsigned long)pSrc;
-    xfer[0].len = nwrite;
-    xfer[0].speed_hz = speed;
-    xfer[0].bits_per_word = bits;
+    HbiBusLock(pDev);
+    start = HbiStatsNowNs();
+    ret = pDev->pTransport->read(pDev, pSrc, pDst, nread, nwrite);
+    end = HbiPortAccount(pDev, start, 1, nwrite, nread, ret);
+    if (HbiPortTraced(pDev))
+    {
+        HbiPortTrace(pDev, true, start, end, ret ? 0 : HBI_TRACE_F_ERROR,
+            pSrc, nwrite, NULL, 0, pDst, nread);
+    }
+    HbiBusUnlock(pDev);
+    return ret;
+}
 
-    xfer[1].rx_buf = (unsigned long)pDst;
-    xfer[1].len = nread;
-    xfer[1].speed_hz = speed;
-    xfer[1].bits_per_word = bits;
+/*********************************************************************************/
+/* 					Write raw data to Device.					                 */
+/*********************************************************************************/
+bool HbiPortWrite(HbiDevice *pDev, uint8_t const *tx, uint8_t const *rx, size_t len)
+{
+    uint64_t start, end;
+    bool ret;
 
-    ret = ioctl(fd, SPI_IOC_MESSAGE(2), &xfer);
-    if (ret < 1)
+    HbiBusLock(pDev);
+    start = HbiStatsNowNs();
+    /* raw data may hold its own page select commands and register writes */
+    HbiPageInvalidate(pDev);
+    HbiCacheInvalidate(pDev->pCache);
+    ret = pDev->pTransport->write(pDev, tx, rx, len);
+    end = HbiPortAccount(pDev, start, 1, len, rx ? len : 0, ret);
+    if (HbiPortTraced(pDev))
+    {
+        HbiPortTrace(pDev, true, start, end,
+            HBI_TRACE_F_RAW | (ret ? 0 : HBI_TRACE_F_ERROR), tx, len, NULL, 0, rx, rx ? len : 0);
+    }
+    HbiBusUnlock(pDev);
+    return ret;
+}
+
+/*********************************************************************************/
+/* 					Write a frame header and its payload to Device.              */
+/*********************************************************************************/
+bool HbiPortWriteFrame(HbiDevice *pDev, uint8_t const *hdr, size_t nhdr,
+    uint8_t const *data, size_t ndata)
+{
+    uint64_t start, end;
+    bool ret;
+
+    if (!pDev->pTransport->writeFrame && ((nhdr + ndata) > HBI_XFER_BUF_BYTES))
     {
-        printf("can't send spi message");
         return false;
     }
 
-    return true;
+    HbiBusLock(pDev);
+    start = HbiStatsNowNs();
+    if (pDev->pTransport->writeFrame)
+    {
+        ret = pDev->pTransport->writeFrame(pDev, hdr, nhdr, data, ndata);
+    }
+    else
+    {
+        /* transport can't gather, send header and payload from one buffer.
+           HbiWrite() already places the payload right after the header */
+        memcpy(&pDev->xferBuf[0], hdr, nhdr);
+        if (data != &pDev->xferBuf[nhdr])
+        {
+            memcpy(&pDev->xferBuf[nhdr], data, ndata);
+        }
+        ret = pDev->pTransport->write(pDev, pDev->xferBuf, NULL, nhdr + ndata);
+    }
+    end = HbiPortAccount(pDev, start, 1, nhdr + ndata, 0, ret);
+    if (HbiPortTraced(pDev))
+    {
+        HbiPortTrace(pDev, true, start, end, ret ? 0 : HBI_TRACE_F_ERROR,
+            hdr, nhdr, data, ndata, NULL, 0);
+    }
+    HbiBusUnlock(pDev);
+    return ret;
 }
-#endif
+
 /*********************************************************************************/
-/* 					Write to Device.							                 */
-/* This example implementation is for user-mode linux. This 	                 */
-/* code should be ported to the client's specific HW host mcu/mpu                */
+/* 					Send a batch of HBI frames to Device.		                 */
 /*********************************************************************************/
-#ifdef I2C
-bool HbiPortWrite(int32_t i2c_fd, uint8_t const *tx, uint8_t const *rx, size_t len)
+bool HbiPortBatch(HbiDevice *pDev, HbiBatch *pBatch)
 {
-    struct i2c_msg msgs[1];
-    struct i2c_rdwr_ioctl_data msgset[1];
-    int i, ret_val;
+    HbiBatchFrame *pFrame;
+    int32_t i;
+    size_t ntx = 0, nrx = 0;
+    uint64_t start, end;
+    uint8_t flags;
+    bool ret = true;
 
-    msgs[0].addr = I2C_SLAVE_ADDRESS;
-    msgs[0].flags = 0;
-    msgs[0].len = len;
-    msgs[0].buf = tx;
+    HbiBusLock(pDev);
+    start = HbiStatsNowNs();
+    if (pDev->pTransport->batch)
+    {
+        ret = pDev->pTransport->batch(pDev, pBatch);
+        for (i = 0; i < pBatch->numFrames; i++)
+        {
+            ntx += pBatch->frame[i].txLen;
+            nrx += pBatch->frame[i].rxLen;
+        }
+        end = HbiPortAccount(pDev, start, pBatch->numFrames, ntx, nrx, ret);
+        if (HbiPortTraced(pDev))
+        {
+            flags = ((pBatch->numFrames > 1) ? HBI_TRACE_F_BATCH : 0) | (ret ? 0 : HBI_TRACE_F_ERROR);
+            for (i = 0; i < pBatch->numFrames; i++)
+            {
+                pFrame = &pBatch->frame[i];
+                HbiPortTrace(pDev, i == 0, start, end,
+                    flags | ((pBatch->raw && !pFrame->size) ? HBI_TRACE_F_RAW : 0), pFrame->tx,
+                    pFrame->txLen, NULL, 0, pFrame->rx, pFrame->rxLen);
+            }
+        }
+        HbiBusUnlock(pDev);
+        return ret;
+    }
 
-    msgset[0].msgs = msgs;
-    msgset[0].nmsgs = 1;
+    /* transport has no batch support, send the frames one by one */
+    for (i = 0; ret && (i < pBatch->numFrames); i++)
+    {
+        pFrame = &pBatch->frame[i];
+        start = HbiStatsNowNs();
+        if (pFrame->rxLen)
+        {
+            ret = pDev->pTransport->read(pDev, (uint8_t *)pFrame->tx, pFrame->rx,
+                pFrame->rxLen, pFrame->txLen);
+        }
+        else
+        {
+            ret = pDev->pTransport->write(pDev, pFrame->tx, NULL,
+                pFrame->txLen);
+        }
+        end = HbiPortAccount(pDev, start, 1, pFrame->txLen, pFrame->rxLen, ret);
+        if (HbiPortTraced(pDev))
+        {
+            HbiPortTrace(pDev, true, start, end,
+                ((pBatch->raw && !pFrame->size) ? HBI_TRACE_F_RAW : 0) | (ret ? 0 : HBI_TRACE_F_ERROR),
+                pFrame->tx, pFrame->txLen, NULL, 0, pFrame->rx, pFrame->rxLen);
+        }
+    }
+    HbiBusUnlock(pDev);
+    return ret;
+}
 
-    if (ioctl(i2c_fd, I2C_RDWR, &msgset) < 0) {
-        printf("ioctl(I2C_RDWR) in i2c_write");
-        close(i2c_fd);
-        return false;
+/* sleep until the given CLOCK_MONOTONIC time, restarting if interrupted */
+static void HbiPortSleepUntil(struct timespec const *pWake)
+{
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, pWake, NULL) == EINTR)
+    {
     }
-    return true;
 }
-#else
-bool HbiPortWrite(int32_t fd, uint8_t const *tx, uint8_t const *rx, size_t len)
+
+/* CLOCK_MONOTONIC time usec microseconds from now */
+static void HbiPortTimeAfter(struct timespec *pTime, uint64_t usec)
 {
-    int32_t ret = 0;
-    struct spi_ioc_transfer tr = { 0 };
+    clock_gettime(CLOCK_MONOTONIC, pTime);
+    pTime->tv_sec += usec / 1000000;
+    pTime->tv_nsec += (usec % 1000000) * 1000;
+    if (pTime->tv_nsec >= 1000000000)
+    {
+        pTime->tv_sec++;
+        pTime->tv_nsec -= 1000000000;
+    }
+}
 
-    tr.tx_buf = (unsigned long)tx;
-    tr.rx_buf = (unsigned long)rx,
-        tr.len = len;
-    tr.speed_hz = speed;
-    tr.bits_per_word = bits;
+/* delay functions, the calling thread sleeps instead of spinning unless the
+   transport provides its own notion of time */
+void HbiPortDelayUs(HbiDevice *pDev, uint32_t usec /*microseconds*/)
+{
+    struct timespec wake;
+    uint64_t start = HbiStatsNowNs();
 
-    ret = ioctl(fd, SPI_IOC_MESSAGE(1), &tr);
-    if (ret < 1)
+    if (pDev && pDev->pTransport->delay)
     {
-        printf("hbi_spi_write: can't send spi message");
-        return false;
+        pDev->pTransport->delay(pDev, usec);
+    }
+    else
+    {
+        HbiPortTimeAfter(&wake, usec);
+        HbiPortSleepUntil(&wake);
     }
 
-    return true;
+    if (pDev)
+    {
+        HbiBusLock(pDev);
+        HbiStatsRecord(&pDev->stats, HBI_STATS_DELAY, start);
+        HbiBusUnlock(pDev);
+    }
 }
-#endif
-/* delay function */
-void HbiPortDelay(int32_t msec /*milliseconds*/)
-{
-    long delayT;
-    clock_t start, end;
 
-    delayT = msec*(CLOCKS_PER_SEC / 1000);
-    start = end = clock();
-    while ((end - start) < delayT)
+void HbiPortDelay(HbiDevice *pDev, int32_t msec /*milliseconds*/)
+{
+    if (msec > 0)
     {
-        end = clock();
+        HbiPortDelayUs(pDev, (uint32_t)msec * 1000);
     }
 }
 /*********************************************************************************/
 /*  Description: this function makes transport frame header for command          */
-/*  to be sent over HBI                                                          */
+/*  to be sent over HBI. The page select is skipped if pCurPage says the page is */
+/*  already selected on the device, pCurPage is updated to the page selected.    */
 /*********************************************************************************/
 static void HbiFrameHdr(uint16_t 	addr,
     int32_t       read,
     size_t     size,
     uint8_t 	*cmd,
-    size_t		*cmdlen)
+    size_t		*cmdlen,
+    uint8_t     *pCurPage)
 {
     uint8_t         page = addr >> 8;
     uint8_t         offset = (addr & 0xFF) >> 1;
@@ -319,16 +499,19 @@ static void HbiFrameHdr(uint16_t 	addr,
     *cmdlen = 0;
     if (page)
     {
-        if (page != 0xFF)
+        i = 0;
+        if ((pCurPage == NULL) || (*pCurPage != page))
         {
-            page -= 1;
-        }
+            val = HBI_SELECT_PAGE((page != 0xFF) ? (page - 1) : page);
 
-        val = HBI_SELECT_PAGE(page);
+            cmd[i++] = val >> 8;
+            cmd[i++] = val & 0xFF;
 
-        i = 0;
-        cmd[i++] = val >> 8;
-        cmd[i++] = val & 0xFF;
+            if (pCurPage)
+            {
+                *pCurPage = page;
+            }
+        }
 
         if (read)
         {
@@ -365,14 +548,18 @@ static void HbiFrameHdr(uint16_t 	addr,
     return;
 }
 
-HbiStatus HbiWrite(int32_t fd, uint16_t reg_addr, uint8_t *data, int32_t size)
+HbiStatus HbiWrite(HbiDevice *pDev, uint16_t reg_addr, uint8_t const *data, int32_t size)
 {
     uint8_t cmd[4] = { 0 };
-    uint8_t buf[260]; //buffer size max will be 256+4 (data size + command size) 
-    size_t cmd_len, i;
+    size_t cmd_len;
     int32_t ret = 0;
-    uint16_t *dataPtr = (uint16_t *)data;
+    uint8_t const *payload = data;
+    uint64_t start = HbiStatsNowNs();
     HbiStatus status = HBI_STATUS_SUCCESS;
+    if (pDev == NULL)
+    {
+        return HBI_STATUS_INVALID_ARG;
+    }
     if (size > ZL380xx_MAX_ACCESS_SIZE_IN_BYTES)
     {
         printf("Size exceed.Received %d,Maximum limit to transfer data is %d\n",
@@ -380,126 +567,1157 @@ HbiStatus HbiWrite(int32_t fd, uint16_t reg_addr, uint8_t *data, int32_t size)
         return HBI_STATUS_INVALID_ARG;
     }
 
-    for (i = 0; i < (size >> 1); i++)
-    {
-        dataPtr[i] = HBI_VAL(HBI_DEV_ENDIAN_BIG, dataPtr[i]);
-    }
+    /* page select and access must reach the device back to back */
+    HbiBusLock(pDev);
 
-    HbiFrameHdr(reg_addr, 0, size, &cmd[0], &cmd_len);
-    for (i = 0; i < cmd_len; i++)
-    {
-        buf[i] = cmd[i];
-    }
-    for (i = 0; i < size; i++)
-    {
-        buf[cmd_len + i] = data[i];
-    }
+    HbiFrameHdr(reg_addr, 0, size, &cmd[0], &cmd_len, &pDev->page);
 
+    /* convert into the frame buffer, right behind the header, only if host
+       and device endianness differ, otherwise send the caller's buffer */
+#if !MATCH_ENDIAN(HBI_DEV_ENDIAN_BIG)
+    HbiConvertWords(&pDev->xferBuf[cmd_len], data, size >> 1);
+    payload = &pDev->xferBuf[cmd_len];
+#endif
 
-    ret = HbiPortWrite(fd, &buf[0], NULL, cmd_len + size);
+    ret = HbiPortWriteFrame(pDev, &cmd[0], cmd_len, payload, size);
+    HbiPortAccountFrame(pDev, reg_addr, cmd_len, size);
 
     if (ret < 1)
     {
+        HbiPageInvalidate(pDev);
+        HbiCacheInvalidate(pDev->pCache);
         status = HBI_STATUS_INTERNAL_ERR;
-        return status;
     }
+    else
+    {
+        HbiCacheFill(pDev->pCache, reg_addr, data, size, false);
+    }
+    HbiStatsRecord(&pDev->stats, HBI_STATS_WRITE, start);
+    HbiBusUnlock(pDev);
 
     return status;
 }
 
 
-HbiStatus HbiRead(int32_t fd, uint16_t reg_addr, uint8_t *buf, int32_t size)
+/* read registers, from the register shadow if cached is set and it holds them,
+   otherwise from the device. A device read refreshes the shadow */
+static HbiStatus HbiReadFrame(HbiDevice *pDev, uint16_t reg_addr, uint8_t *buf, int32_t size,
+    bool cached)
 {
     uint8_t cmd[4] = { 0 };
-    size_t cmd_len, i;
+    size_t cmd_len, len;
     int32_t ret = 0;
-    uint16_t *bufPtr = (uint16_t *)buf;
-    uint16_t temp;
+    uint8_t *rdBuf = buf;
+    uint64_t start = HbiStatsNowNs();
     HbiStatus status = HBI_STATUS_SUCCESS;
 
-    HbiFrameHdr(reg_addr, 1, size, &cmd[0], &cmd_len);
+    if (pDev == NULL)
+    {
+        return HBI_STATUS_INVALID_ARG;
+    }
+    HbiBusLock(pDev);
+    if (cached && HbiCacheLookup(pDev->pCache, reg_addr, buf, size))
+    {
+        pDev->stats.cacheHits++;
+        HbiStatsRecord(&pDev->stats, HBI_STATS_READ, start);
+        HbiBusUnlock(pDev);
+        return status;
+    }
+    if (pDev->pCache)
+    {
+        pDev->stats.cacheMisses++;
+    }
+
+    /* a miss fetches the registers that follow as well if read ahead is on */
+    len = cached ? HbiCacheReadAhead(pDev->pCache, reg_addr, size) : (size_t)size;
+    if (len > (size_t)size)
+    {
+        rdBuf = pDev->xferBuf;
+    }
+
+    HbiFrameHdr(reg_addr, 1, len, &cmd[0], &cmd_len, &pDev->page);
 
-    ret = HbiPortRead(fd, &cmd, buf, size, cmd_len);
+    ret = HbiPortRead(pDev, &cmd, rdBuf, len, cmd_len);
+    HbiPortAccountFrame(pDev, reg_addr, cmd_len, len);
 
     if (ret < 1)
     {
+        HbiPageInvalidate(pDev);
+        HbiStatsRecord(&pDev->stats, HBI_STATS_READ, start);
+        HbiBusUnlock(pDev);
         status = HBI_STATUS_INTERNAL_ERR;
         return status;
     }
-    for (i = 0; i < (size >> 1); i++)
+    HbiConvertWords(rdBuf, rdBuf, len >> 1);
+    HbiCacheFill(pDev->pCache, reg_addr, rdBuf, len, false);
+    /* the frame buffer is only ours while the bus lock is held */
+    if (rdBuf != buf)
     {
-        temp = bufPtr[i];
-        bufPtr[i] = HBI_VAL(HBI_DEV_ENDIAN_BIG, temp);
+        memcpy(buf, rdBuf, size);
     }
+    HbiStatsRecord(&pDev->stats, HBI_STATS_READ, start);
+    HbiBusUnlock(pDev);
 
     return status;
 }
 
+HbiStatus HbiRead(HbiDevice *pDev, uint16_t reg_addr, uint8_t *buf, int32_t size)
+{
+    return HbiReadFrame(pDev, reg_addr, buf, size, true);
+}
+
 /*********************************************************************************/
-/*    Writing a host command into Command register and processing it             */
-/*     is a 3-step process                                                       */
-/*     1. check if there's any command in process by monitoring sw flag regs.    */
-/*     if yes, wait for it to compelete                                          */
-/*     2. if no command in progress, then write current command in to command    */
-/*     register and issue notice to firmware that a host command is written      */
-/*     3. wait for current command to complete                                   */
+/*  Description: forget device state cached by the driver. Must be called after  */
+/*  anything that resets the device or changes its HBI state behind the driver.  */
 /*********************************************************************************/
-HbiStatus HbiWriteHostCmd(int32_t fd, uint16_t cmd)
+void HbiInvalidateCache(HbiDevice *pDev)
 {
-    HbiStatus status = HBI_STATUS_SUCCESS;
-    int32_t hmi_response;
-    uint16_t  i = 0;
-    uint16_t  temp = 0x0BAD;
-    uint16_t  buf;
-    /* check whether there's any ongoing command */
-    for (i = 0; i < TWOLF_MBCMDREG_SPINWAIT; i++)
+    HbiBusLock(pDev);
+    HbiPageInvalidate(pDev);
+    HbiCacheInvalidate(pDev->pCache);
+    HbiBusUnlock(pDev);
+}
+
+/*********************************************************************************/
+/*  Description: start a transaction on pDev. Until the matching                 */
+/*  HbiTransactionEnd() no other thread accesses the device or issues a host     */
+/*  command, so sequences that depend on device state (page 255 base, host       */
+/*  command results, raw image streams) are not interleaved with other users.    */
+/*  Transactions nest and may contain any driver call. Other devices are not     */
+/*  affected.                                                                    */
+/*********************************************************************************/
+HbiStatus HbiTransactionBegin(HbiDevice *pDev)
+{
+    if (pDev == NULL)
     {
-        status = HbiRead(fd, 0x0006, (uint8_t *)&temp, sizeof(temp));
-        CHK_STATUS(status);
-        if (!(temp & 0x1))
-        {
-            break;
-        }
-        HbiPortDelay(10);
+        return HBI_STATUS_BAD_HANDLE;
+    }
+    pthread_mutex_lock(&pDev->cmdLock);
+    HbiBusLock(pDev);
+    return HBI_STATUS_SUCCESS;
+}
+
+HbiStatus HbiTransactionEnd(HbiDevice *pDev)
+{
+    if (pDev == NULL)
+    {
+        return HBI_STATUS_BAD_HANDLE;
     }
-    if ((i >= TWOLF_MBCMDREG_SPINWAIT) && (temp & 0x1))
+    HbiBusUnlock(pDev);
+    pthread_mutex_unlock(&pDev->cmdLock);
+    return HBI_STATUS_SUCCESS;
+}
+
+/*********************************************************************************/
+/*  Description: wire bytes one batch of pDev can hold, the largest message the  */
+/*  bus carries: the spidev bufsiz, the i2c-dev limit or HbiDeviceCfg.maxMsg     */
+/*********************************************************************************/
+size_t HbiBatchMaxBytes(HbiDevice *pDev)
+{
+    if (pDev == NULL)
     {
-        return HBI_STATUS_RESOURCE_ERR;
+        return 0;
     }
+    return pDev->maxMsg ? pDev->maxMsg : HBI_SPIDEV_BUFSIZ;
+}
 
-    /* write the command into the Host Command register*/
-    /*0x0032:  Host Command register*/
-    //cmd = HBI_VAL(HBI_DEV_ENDIAN_BIG, cmd);
-    status = HbiWrite(fd, 0x0032, (uint8_t *)&cmd, sizeof(cmd));
-    CHK_STATUS(status);
+/*********************************************************************************/
+/*  Description: frames one batch of pDev can hold                              */
+/*********************************************************************************/
+int32_t HbiBatchMaxFrames(HbiDevice *pDev)
+{
+    size_t n = HbiBatchMaxBytes(pDev) / HBI_BATCH_FRAME_BYTES;
 
-    /* Issue "Host Command Written" notice to firmware */
-    cmd = 0x1;//HBI_VAL(HBI_DEV_ENDIAN_BIG, 0x1);
-    status = HbiWrite(fd, 0x0006, (uint8_t *)&cmd, sizeof(cmd));
-    CHK_STATUS(status);
+    return (n > HBI_BATCH_MIN_FRAMES) ? (int32_t)n : HBI_BATCH_MIN_FRAMES;
+}
 
-    /* check whether the last command is completed */
-    temp = 0x0BAD;
-    for (i = 0; i < TWOLF_MBCMDREG_SPINWAIT; i++)
+/*********************************************************************************/
+/*  Description: bytes a frame sending txLen and receiving rxLen bytes takes of  */
+/*  HbiBatchMaxBytes(). The bus may count more than the frame carries, spidev    */
+/*  rounds every transfer up to the DMA alignment of the host.                   */
+/*********************************************************************************/
+size_t HbiBatchFrameBytes(HbiDevice *pDev, size_t txLen, size_t rxLen)
+{
+    if (pDev == NULL)
     {
-        status = HbiRead(fd, 0x0032, (uint8_t *)&temp, sizeof(temp));
-        CHK_STATUS(status);
+        return txLen + rxLen;
+    }
+    return HbiMsgLen(pDev, txLen) + (rxLen ? HbiMsgLen(pDev, rxLen) : 0);
+}
 
-        if (temp == 0) /* HOST_CMD_IDLE */
-        {
-            break;
-        }
-        HbiPortDelay(10);
+/*********************************************************************************/
+/*  Description: start collecting HBI frames to be sent to device in a single    */
+/*  bus transaction by HbiBatchSubmit(). The batch takes storage sized to the    */
+/*  bus limit of pDev, it must be given back with HbiBatchEnd().                 */
+/*********************************************************************************/
+HbiStatus HbiBatchBegin(HbiDevice *pDev, HbiBatch *pBatch)
+{
+    void *pMem;
+
+    if (pBatch == NULL)
+    {
+        return HBI_STATUS_INVALID_ARG;
+    }
+    /* HbiBatchEnd() is harmless after a failed begin */
+    pBatch->frame = NULL;
+    pBatch->buf = NULL;
+    if (pDev == NULL)
+    {
+        return HBI_STATUS_INVALID_ARG;
+    }
+    pBatch->maxBytes = HbiBatchMaxBytes(pDev);
+    pBatch->maxFrames = HbiBatchMaxFrames(pDev);
+
+    /* the pool slots were sized to the bus limit when the device was
+       opened, a batch beyond them gets storage laid out the same way */
+    pMem = HbiBufBatchGet(pDev);
+    if ((pMem == NULL) && (posix_memalign(&pMem, HBI_CACHE_LINE, pDev->batchStride) != 0))
+    {
+        return HBI_STATUS_RESOURCE_ERR;
     }
-    if ((i >= TWOLF_MBCMDREG_SPINWAIT) && (temp != 0))
+    pBatch->buf = pMem;
+    pBatch->frame = (HbiBatchFrame *)((uint8_t *)pMem + pDev->batchFrameOffset);
+    pBatch->pDev = pDev;
+    pBatch->page = 0;
+    pBatch->raw = false;
+    pBatch->numFrames = 0;
+    pBatch->txUsed = 0;
+    pBatch->wireLen = 0;
+    pBatch->msgUsed = 0;
+
+    return HBI_STATUS_SUCCESS;
+}
+
+/* queue one frame made of hdr followed by either a write payload (data) or
+   the read data to be clocked into rx */
+static HbiStatus HbiBatchAppendFrame(HbiBatch *pBatch, uint16_t reg_addr, uint8_t const *hdr,
+    size_t hdrLen, uint8_t const *data, uint8_t *rx, size_t size)
+{
+    HbiBatchFrame *pFrame;
+    size_t msgLen;
+
+    /* a write frame goes out as one transfer, a read frame as the header
+       followed by the read data */
+    msgLen = rx ? HbiBatchFrameBytes(pBatch->pDev, hdrLen, size) :
+        HbiBatchFrameBytes(pBatch->pDev, hdrLen + size, 0);
+    if ((pBatch->numFrames >= pBatch->maxFrames) ||
+        ((pBatch->msgUsed + msgLen) > pBatch->maxBytes))
     {
         return HBI_STATUS_RESOURCE_ERR;
     }
 
+    pFrame = &pBatch->frame[pBatch->numFrames];
+    pFrame->tx = &pBatch->buf[pBatch->txUsed];
+    pFrame->txLen = hdrLen;
+    pFrame->rx = rx;
+    pFrame->rxLen = rx ? size : 0;
+    pFrame->reg = reg_addr;
+    pFrame->size = size;
 
-    return status;
+    memcpy(&pBatch->buf[pBatch->txUsed], hdr, hdrLen);
+    pBatch->txUsed += hdrLen;
+
+    if (data)
+    {
+        /* payload is copied in device format, the caller's buffer is
+           left untouched and may be reused */
+        HbiConvertWords(&pBatch->buf[pBatch->txUsed], data, size >> 1);
+        pFrame->txLen += size;
+        pBatch->txUsed += size;
+    }
+
+    pBatch->wireLen += hdrLen + size;
+    pBatch->msgUsed += msgLen;
+    pBatch->numFrames++;
+
+    return HBI_STATUS_SUCCESS;
 }
 
+/*********************************************************************************/
+/*  Description: queue a register write. The payload is copied into the batch,   */
+/*  data may be reused as soon as this function returns.                         */
+/*********************************************************************************/
+HbiStatus HbiBatchAppendWrite(HbiBatch *pBatch, uint16_t reg_addr, uint8_t const *data, int32_t size)
+{
+    uint8_t cmd[4] = { 0 };
+    size_t cmd_len;
+    uint8_t page;
+    HbiStatus status;
 
+    if (pBatch == NULL || data == NULL || size <= 0 || size > ZL380xx_MAX_ACCESS_SIZE_IN_BYTES)
+    {
+        return HBI_STATUS_INVALID_ARG;
+    }
+    page = pBatch->page;
+    HbiFrameHdr(reg_addr, 0, size, &cmd[0], &cmd_len, &pBatch->page);
 
+    status = HbiBatchAppendFrame(pBatch, reg_addr, &cmd[0], cmd_len, data, NULL, size);
+    if (status != HBI_STATUS_SUCCESS)
+    {
+        /* a page select in cmd was not queued */
+        pBatch->page = page;
+    }
+    return status;
+}
 
+/*********************************************************************************/
+/*  Description: queue a register read. Data lands in buf once the batch has     */
+/*  been submitted successfully.                                                 */
+/*********************************************************************************/
+HbiStatus HbiBatchAppendRead(HbiBatch *pBatch, uint16_t reg_addr, uint8_t *buf, int32_t size)
+{
+    uint8_t cmd[4] = { 0 };
+    size_t cmd_len;
+    uint8_t page;
+    HbiStatus status;
+
+    if (pBatch == NULL || buf == NULL || size <= 0 || size > ZL380xx_MAX_ACCESS_SIZE_IN_BYTES)
+    {
+        return HBI_STATUS_INVALID_ARG;
+    }
+    page = pBatch->page;
+    HbiFrameHdr(reg_addr, 1, size, &cmd[0], &cmd_len, &pBatch->page);
+
+    status = HbiBatchAppendFrame(pBatch, reg_addr, &cmd[0], cmd_len, NULL, buf, size);
+    if (status != HBI_STATUS_SUCCESS)
+    {
+        /* a page select in cmd was not queued */
+        pBatch->page = page;
+    }
+    return status;
+}
+
+/*********************************************************************************/
+/*  Description: queue len bytes of ready made HBI frames in device format, e.g. */
+/*  a firmware image block. Nothing is copied, data must stay untouched until    */
+/*  the batch has been submitted. The driver can't tell what the frames do, the  */
+/*  selected page and the register cache are dropped when the batch is sent.     */
+/*********************************************************************************/
+HbiStatus HbiBatchAppendRaw(HbiBatch *pBatch, uint8_t const *data, size_t len)
+{
+    HbiBatchFrame *pFrame;
+
+    if (pBatch == NULL || data == NULL || len == 0)
+    {
+        return HBI_STATUS_INVALID_ARG;
+    }
+    if ((pBatch->numFrames >= pBatch->maxFrames) ||
+        ((pBatch->msgUsed + HbiBatchFrameBytes(pBatch->pDev, len, 0)) > pBatch->maxBytes))
+    {
+        return HBI_STATUS_RESOURCE_ERR;
+    }
+
+    pFrame = &pBatch->frame[pBatch->numFrames];
+    pFrame->tx = data;
+    pFrame->txLen = len;
+    pFrame->rx = NULL;
+    pFrame->rxLen = 0;
+    pFrame->reg = 0;
+    pFrame->size = 0;
+
+    /* frames queued after this one select their page again */
+    pBatch->page = 0;
+    pBatch->raw = true;
+    pBatch->wireLen += len;
+    pBatch->msgUsed += HbiBatchFrameBytes(pBatch->pDev, len, 0);
+    pBatch->numFrames++;
+
+    return HBI_STATUS_SUCCESS;
+}
+
+/*********************************************************************************/
+/*  Description: send all queued frames in one bus transaction and convert read  */
+/*  data to host format. The batch is emptied and can be reused afterwards.      */
+/*********************************************************************************/
+HbiStatus HbiBatchSubmit(HbiBatch *pBatch)
+{
+    HbiBatchFrame *pFrame;
+    int32_t ret = 0;
+    int32_t i;
+    HbiStatus status = HBI_STATUS_SUCCESS;
+
+    if (pBatch == NULL)
+    {
+        return HBI_STATUS_INVALID_ARG;
+    }
+    if (pBatch->numFrames == 0)
+    {
+        return status;
+    }
+
+    HbiBusLock(pBatch->pDev);
+    ret = HbiPortBatch(pBatch->pDev, pBatch);
+    if (ret < 1)
+    {
+        /* unknown how far the transfer got, select page again and forget
+           the register shadow */
+        HbiPageInvalidate(pBatch->pDev);
+        HbiCacheInvalidate(pBatch->pDev->pCache);
+        status = HBI_STATUS_INTERNAL_ERR;
+    }
+    else
+    {
+        if (pBatch->raw)
+        {
+            HbiPageInvalidate(pBatch->pDev);
+        }
+        if (pBatch->page)
+        {
+            pBatch->pDev->page = pBatch->page;
+        }
+    }
+
+    for (i = 0; (status == HBI_STATUS_SUCCESS) && (i < pBatch->numFrames); i++)
+    {
+        pFrame = &pBatch->frame[i];
+        if (pFrame->size == 0)
+        {
+            /* raw frame, only counted in the bus totals like HbiPortWrite() */
+            continue;
+        }
+        HbiPortAccountFrame(pBatch->pDev, pFrame->reg,
+            pFrame->rxLen ? pFrame->txLen : (pFrame->txLen - pFrame->size), pFrame->size);
+        if (pFrame->rxLen)
+        {
+            HbiConvertWords(pFrame->rx, pFrame->rx, pFrame->rxLen >> 1);
+            HbiCacheFill(pBatch->pDev->pCache, pFrame->reg, pFrame->rx, pFrame->size, false);
+        }
+        else
+        {
+            /* write payload follows the header in the batch buffer */
+            HbiCacheFill(pBatch->pDev->pCache, pFrame->reg,
+                &pFrame->tx[pFrame->txLen - pFrame->size], pFrame->size, true);
+        }
+    }
+    if (pBatch->raw && (status == HBI_STATUS_SUCCESS))
+    {
+        HbiCacheInvalidate(pBatch->pDev->pCache);
+    }
+    HbiBusUnlock(pBatch->pDev);
+
+    /* other accesses may change the page before the batch is used again */
+    pBatch->page = 0;
+    pBatch->raw = false;
+    pBatch->numFrames = 0;
+    pBatch->txUsed = 0;
+    pBatch->wireLen = 0;
+    pBatch->msgUsed = 0;
+
+    return status;
+}
+
+/*********************************************************************************/
+/*  Description: give the storage of a batch back. Frames not submitted are      */
+/*  dropped, the batch can be started again with HbiBatchBegin().                */
+/*********************************************************************************/
+void HbiBatchEnd(HbiBatch *pBatch)
+{
+    if ((pBatch == NULL) || (pBatch->frame == NULL))
+    {
+        return;
+    }
+    if (!HbiBufBatchPut(pBatch->pDev, pBatch->buf))
+    {
+        free(pBatch->buf);
+    }
+    pBatch->frame = NULL;
+    pBatch->buf = NULL;
+    pBatch->numFrames = 0;
+}
+
+/* check that a block access stays within the register pages or within the
+   page 255 memory window selected by register 0x000C */
+static HbiStatus HbiBlockCheck(uint16_t reg_addr, size_t size)
+{
+    uint32_t end = (uint32_t)reg_addr + size;
+
+    if ((size == 0) || (size & 1) || (reg_addr & 1))
+    {
+        return HBI_STATUS_INVALID_ARG;
+    }
+    if ((reg_addr >> 8) == 0xFF)
+    {
+        if (end > 0x10000)
+        {
+            return HBI_STATUS_INVALID_ARG;
+        }
+    }
+    else if (end > 0xFF00)
+    {
+        return HBI_STATUS_INVALID_ARG;
+    }
+    return HBI_STATUS_SUCCESS;
+}
+
+/* largest payload of one block frame, HBI_MAX_FRAME_PAYLOAD or less if the
+   bus limits its messages, leaving room for page select and offset in what
+   the bus counts for the frame */
+static size_t HbiFramePayload(HbiDevice *pDev)
+{
+    size_t limit = pDev->maxMsg;
+
+    if (pDev->msgAlign && (limit >= pDev->msgAlign))
+    {
+        limit -= limit % pDev->msgAlign;
+    }
+    if (limit && (limit < (HBI_MAX_FRAME_PAYLOAD + 4)))
+    {
+        return (limit > 6) ? ((limit - 4) & ~(size_t)1) : 2;
+    }
+    return HBI_MAX_FRAME_PAYLOAD;
+}
+
+/* bytes that can be accessed from reg_addr before crossing into the next page */
+static size_t HbiPageRemain(uint16_t reg_addr)
+{
+    return 0x100 - (reg_addr & 0xFF);
+}
+
+/* HbiWriteBlock() with the bus locked, the frames of one block rely on the
+   page and continuation address left by the previous submit */
+static HbiStatus HbiWriteBlockLocked(HbiDevice *pDev, uint16_t reg_addr, uint8_t const *data, size_t size)
+{
+    HbiBatch batch;
+    HbiStatus status;
+    uint8_t cmd[4] = { 0 };
+    size_t cmd_len, chunk, maxChunk = HbiFramePayload(pDev);
+    uint16_t val;
+    uint8_t page;
+    bool paged = false, hdr;
+
+    if (data == NULL)
+    {
+        return HBI_STATUS_INVALID_ARG;
+    }
+    status = HbiBlockCheck(reg_addr, size);
+    CHK_STATUS(status);
+    status = HbiBatchBegin(pDev, &batch);
+    CHK_STATUS(status);
+
+    while (size)
+    {
+        chunk = HbiPageRemain(reg_addr);
+        if (chunk > maxChunk)
+        {
+            chunk = maxChunk;
+        }
+        if (chunk > size)
+        {
+            chunk = size;
+        }
+
+        /* first frame in a page carries page select and offset, follow-on
+           frames continue the paged write. Direct page access has no
+           continuous write and is framed every time */
+        page = batch.page;
+        hdr = !paged || ((reg_addr >> 8) == 0);
+        if (hdr)
+        {
+            HbiFrameHdr(reg_addr, 0, chunk, &cmd[0], &cmd_len, &batch.page);
+            paged = true;
+        }
+        else
+        {
+            val = HBI_CONT_PAGED_WRITE((chunk >> 1) - 1);
+            cmd[0] = val >> 8;
+            cmd[1] = val & 0xFF;
+            cmd_len = 2;
+        }
+
+        status = HbiBatchAppendFrame(&batch, reg_addr, &cmd[0], cmd_len, data, NULL, chunk);
+        if (status == HBI_STATUS_RESOURCE_ERR)
+        {
+            /* the page select in cmd was not queued, don't let the submit
+               record it. The next batch starts without a known page, so
+               a header frame is built again */
+            batch.page = page;
+            status = HbiBatchSubmit(&batch);
+            if (status == HBI_STATUS_SUCCESS)
+            {
+                if (hdr)
+                {
+                    HbiFrameHdr(reg_addr, 0, chunk, &cmd[0], &cmd_len, &batch.page);
+                }
+                status = HbiBatchAppendFrame(&batch, reg_addr, &cmd[0], cmd_len, data, NULL, chunk);
+            }
+        }
+        if (status != HBI_STATUS_SUCCESS)
+        {
+            break;
+        }
+
+        reg_addr += chunk;
+        data += chunk;
+        size -= chunk;
+        if ((reg_addr & 0xFF) == 0)
+        {
+            paged = false;
+        }
+    }
+
+    if (status == HBI_STATUS_SUCCESS)
+    {
+        status = HbiBatchSubmit(&batch);
+    }
+    HbiBatchEnd(&batch);
+    return status;
+}
+
+/*********************************************************************************/
+/*  Description: write a block of any length starting at reg_addr. The block is  */
+/*  split at page boundaries, every page gets one page select and offset header  */
+/*  and, if it needs more than one frame, is completed with continuous paged     */
+/*  write frames. All frames are sent in as few bus transactions as possible.    */
+/*********************************************************************************/
+HbiStatus HbiWriteBlock(HbiDevice *pDev, uint16_t reg_addr, uint8_t const *data, size_t size)
+{
+    HbiStatus status;
+
+    if (pDev == NULL)
+    {
+        return HBI_STATUS_BAD_HANDLE;
+    }
+    HbiBusLock(pDev);
+    status = HbiWriteBlockLocked(pDev, reg_addr, data, size);
+    HbiBusUnlock(pDev);
+    return status;
+}
+
+/* HbiReadBlock() with the bus locked, later frames omit the page select */
+static HbiStatus HbiReadBlockLocked(HbiDevice *pDev, uint16_t reg_addr, uint8_t *buf, size_t size)
+{
+    HbiBatch batch;
+    HbiStatus status;
+    size_t chunk, maxChunk = HbiFramePayload(pDev);
+
+    if (buf == NULL)
+    {
+        return HBI_STATUS_INVALID_ARG;
+    }
+    status = HbiBlockCheck(reg_addr, size);
+    CHK_STATUS(status);
+    status = HbiBatchBegin(pDev, &batch);
+    CHK_STATUS(status);
+
+    while (size)
+    {
+        chunk = HbiPageRemain(reg_addr);
+        if (chunk > maxChunk)
+        {
+            chunk = maxChunk;
+        }
+        if (chunk > size)
+        {
+            chunk = size;
+        }
+        status = HbiBatchAppendRead(&batch, reg_addr, buf, chunk);
+        if (status == HBI_STATUS_RESOURCE_ERR)
+        {
+            status = HbiBatchSubmit(&batch);
+            if (status == HBI_STATUS_SUCCESS)
+            {
+                status = HbiBatchAppendRead(&batch, reg_addr, buf, chunk);
+            }
+        }
+        if (status != HBI_STATUS_SUCCESS)
+        {
+            break;
+        }
+        reg_addr += chunk;
+        buf += chunk;
+        size -= chunk;
+    }
+
+    if (status == HBI_STATUS_SUCCESS)
+    {
+        status = HbiBatchSubmit(&batch);
+    }
+    HbiBatchEnd(&batch);
+    return status;
+}
+
+/*********************************************************************************/
+/*  Description: read a block of any length starting at reg_addr. The block is   */
+/*  split at page boundaries and frame size limit, all frames are sent in as few */
+/*  bus transactions as possible and read data scattered directly into buf.      */
+/*********************************************************************************/
+HbiStatus HbiReadBlock(HbiDevice *pDev, uint16_t reg_addr, uint8_t *buf, size_t size)
+{
+    HbiStatus status;
+
+    if (pDev == NULL)
+    {
+        return HBI_STATUS_BAD_HANDLE;
+    }
+    HbiBusLock(pDev);
+    status = HbiReadBlockLocked(pDev, reg_addr, buf, size);
+    HbiBusUnlock(pDev);
+    return status;
+}
+
+/*********************************************************************************/
+/*  Description: apply a list of masked register updates. Current values come   */
+/*  from the register shadow where possible, the others are read in one batch.  */
+/*  Only registers whose value actually changes are written, again in one       */
+/*  batch. Several updates of the same register are merged in list order. The   */
+/*  whole sequence is atomic with respect to other threads using pDev.          */
+/*  The shadow is the register cache, so without HbiCacheEnable() every         */
+/*  register is read first: a no-op update still costs that read and only the   */
+/*  write is saved. No value is remembered outside the cache, since the device  */
+/*  may change a register between two updates.                                  */
+/*********************************************************************************/
+HbiStatus HbiUpdateBitsMulti(HbiDevice *pDev, HbiBitUpdate const *pUpd, int32_t num)
+{
+    HbiBatch batch;
+    HbiStatus status;
+    uint16_t cur[HBI_UPDATE_MAX_REGS];
+    uint16_t val[HBI_UPDATE_MAX_REGS];
+    int32_t first[HBI_UPDATE_MAX_REGS]; /* index of the first update of the same register */
+    int32_t i, j;
+
+    if (pDev == NULL)
+    {
+        return HBI_STATUS_BAD_HANDLE;
+    }
+    if ((pUpd == NULL) || (num <= 0) || (num > HBI_UPDATE_MAX_REGS))
+    {
+        return HBI_STATUS_INVALID_ARG;
+    }
+    for (i = 0; i < num; i++)
+    {
+        if ((pUpd[i].reg & 1) || ((pUpd[i].reg >> 8) == 0xFF))
+        {
+            return HBI_STATUS_INVALID_ARG;
+        }
+        for (j = 0; (j < i) && (pUpd[j].reg != pUpd[i].reg); j++)
+        {
+        }
+        first[i] = j;
+    }
+
+    HbiBusLock(pDev);
+    status = HbiBatchBegin(pDev, &batch);
+
+    /* fetch what the shadow doesn't know */
+    for (i = 0; (status == HBI_STATUS_SUCCESS) && (i < num); i++)
+    {
+        if ((first[i] != i) ||
+            HbiCacheLookup(pDev->pCache, pUpd[i].reg, (uint8_t *)&cur[i], sizeof(cur[i])))
+        {
+            continue;
+        }
+        status = HbiBatchAppendRead(&batch, pUpd[i].reg, (uint8_t *)&cur[i], sizeof(cur[i]));
+        if (status == HBI_STATUS_RESOURCE_ERR)
+        {
+            status = HbiBatchSubmit(&batch);
+            if (status == HBI_STATUS_SUCCESS)
+            {
+                status = HbiBatchAppendRead(&batch, pUpd[i].reg, (uint8_t *)&cur[i], sizeof(cur[i]));
+            }
+        }
+    }
+    if (status == HBI_STATUS_SUCCESS)
+    {
+        status = HbiBatchSubmit(&batch);
+    }
+
+    /* merge the updates, the final value of a register is kept at its first entry */
+    for (i = 0; (status == HBI_STATUS_SUCCESS) && (i < num); i++)
+    {
+        j = first[i];
+        if (j == i)
+        {
+            val[i] = cur[i];
+        }
+        val[j] = (val[j] & ~pUpd[i].mask) | (pUpd[i].val & pUpd[i].mask);
+    }
+
+    /* write back the registers that changed */
+    for (i = 0; (status == HBI_STATUS_SUCCESS) && (i < num); i++)
+    {
+        if (first[i] != i)
+        {
+            continue;
+        }
+        if (val[i] == cur[i])
+        {
+            pDev->stats.writesSkipped++;
+            continue;
+        }
+        status = HbiBatchAppendWrite(&batch, pUpd[i].reg, (uint8_t *)&val[i], sizeof(val[i]));
+        if (status == HBI_STATUS_RESOURCE_ERR)
+        {
+            status = HbiBatchSubmit(&batch);
+            if (status == HBI_STATUS_SUCCESS)
+            {
+                status = HbiBatchAppendWrite(&batch, pUpd[i].reg, (uint8_t *)&val[i], sizeof(val[i]));
+            }
+        }
+    }
+    if (status == HBI_STATUS_SUCCESS)
+    {
+        status = HbiBatchSubmit(&batch);
+    }
+    HbiBatchEnd(&batch);
+    HbiBusUnlock(pDev);
+
+    return status;
+}
+
+/*********************************************************************************/
+/*  Description: set the bits of register reg selected by mask to val. The      */
+/*  write is skipped if the register already holds that value. The register is  */
+/*  read unless the register cache holds it, see HbiUpdateBitsMulti().          */
+/*********************************************************************************/
+HbiStatus HbiUpdateBits(HbiDevice *pDev, uint16_t reg, uint16_t mask, uint16_t val)
+{
+    HbiBitUpdate upd;
+
+    upd.reg = reg;
+    upd.mask = mask;
+    upd.val = val;
+    return HbiUpdateBitsMulti(pDev, &upd, 1);
+}
+
+/*********************************************************************************/
+/*  Description: request edge events of a GPIO line wired to the device          */
+/*  interrupt output through the Linux GPIO character device (e.g.               */
+/*  /dev/gpiochip0). The line is active low on the ZL380xx, so falling edges are */
+/*  reported unless activeLow is false.                                          */
+/*********************************************************************************/
+HbiStatus HbiEventOpenGpio(HbiEventSource *pSrc, const char *chip, uint32_t line, bool activeLow)
+{
+    struct gpioevent_request req;
+    int32_t chipFd;
+
+    if (pSrc == NULL || chip == NULL)
+    {
+        return HBI_STATUS_INVALID_ARG;
+    }
+    chipFd = open(chip, O_RDWR);
+    if (chipFd < 0)
+    {
+        printf("can't open gpio chip %s\n", chip);
+        return HBI_STATUS_RESOURCE_ERR;
+    }
+
+    memset(&req, 0, sizeof(req));
+    req.lineoffset = line;
+    req.handleflags = GPIOHANDLE_REQUEST_INPUT;
+    req.eventflags = activeLow ? GPIOEVENT_REQUEST_FALLING_EDGE : GPIOEVENT_REQUEST_RISING_EDGE;
+    strncpy(req.consumer_label, "zl380xx-irq", sizeof(req.consumer_label) - 1);
+
+    if (ioctl(chipFd, GPIO_GET_LINEEVENT_IOCTL, &req) < 0)
+    {
+        printf("can't request events on gpio line %u\n", line);
+        close(chipFd);
+        return HBI_STATUS_RESOURCE_ERR;
+    }
+    /* the line event descriptor stays valid after the chip is closed */
+    close(chipFd);
+
+    pSrc->fd = req.fd;
+    pSrc->ack = NULL;
+    pSrc->pUser = NULL;
+    return HBI_STATUS_SUCCESS;
+}
+
+void HbiEventClose(HbiEventSource *pSrc)
+{
+    if (pSrc && (pSrc->fd >= 0))
+    {
+        close(pSrc->fd);
+        pSrc->fd = -1;
+    }
+}
+
+/*********************************************************************************/
+/*  Description: select how host command completion is detected on pDev.        */
+/*  With an event source the driver sleeps until it fires and only then reads   */
+/*  the command register, pSrc NULL goes back to register polling. The source   */
+/*  must stay valid while attached.                                             */
+/*********************************************************************************/
+HbiStatus HbiSetEventSource(HbiDevice *pDev, HbiEventSource *pSrc)
+{
+    if (pDev == NULL)
+    {
+        return HBI_STATUS_BAD_HANDLE;
+    }
+    if (pSrc && (pSrc->fd < 0))
+    {
+        return HBI_STATUS_INVALID_ARG;
+    }
+    /* not while a host command is waiting on the previous source */
+    pthread_mutex_lock(&pDev->cmdLock);
+    pDev->pEvent = pSrc;
+    pthread_mutex_unlock(&pDev->cmdLock);
+    return HBI_STATUS_SUCCESS;
+}
+
+/* consume one pending event; reading fits both eventfd counters and gpio
+   event records */
+static bool HbiEventAck(HbiEventSource *pSrc)
+{
+    uint8_t buf[64];
+
+    if (pSrc->ack)
+    {
+        return pSrc->ack(pSrc);
+    }
+    return (read(pSrc->fd, buf, sizeof(buf)) > 0);
+}
+
+/* wait up to timeoutMs for the source to fire, returns 1 if it did, 0 on
+   timeout and -1 on error */
+static int32_t HbiEventWait(HbiEventSource *pSrc, int32_t timeoutMs)
+{
+    struct pollfd pfd;
+    int32_t ret;
+
+    pfd.fd = pSrc->fd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+
+    do
+    {
+        ret = poll(&pfd, 1, timeoutMs);
+    } while ((ret < 0) && (errno == EINTR));
+
+    if (ret > 0)
+    {
+        if (!(pfd.revents & POLLIN) || !HbiEventAck(pSrc))
+        {
+            return -1;
+        }
+        return 1;
+    }
+    return ret;
+}
+
+/* throw away events raised before the command we are about to issue */
+static void HbiEventDrain(HbiEventSource *pSrc)
+{
+    while (HbiEventWait(pSrc, 0) > 0)
+    {
+    }
+}
+
+/* milliseconds left until deadline, 0 once it has passed */
+static int32_t HbiPortMsUntil(struct timespec const *pDeadline)
+{
+    struct timespec now;
+    int64_t ms;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    ms = (int64_t)(pDeadline->tv_sec - now.tv_sec) * 1000 +
+        (pDeadline->tv_nsec - now.tv_nsec + 999999) / 1000000;
+
+    return (ms > 0) ? (int32_t)ms : 0;
+}
+
+/* wait for the command register to return to idle, reading it only when the
+   event source fires (or every HBI_EVENT_FALLBACK_MS if no edge arrives) */
+static HbiStatus HbiWaitHostCmdEvent(HbiDevice *pDev, HbiEventSource *pSrc)
+{
+    HbiStatus status;
+    struct timespec deadline;
+    int32_t ret, remain;
+    uint16_t temp;
+
+    HbiPortTimeAfter(&deadline, (uint64_t)HBI_HOST_CMD_TIMEOUT_MS * 1000);
+
+    for (;;)
+    {
+        remain = HbiPortMsUntil(&deadline);
+        ret = HbiEventWait(pSrc, (remain < HBI_EVENT_FALLBACK_MS) ? remain : HBI_EVENT_FALLBACK_MS);
+        if (ret < 0)
+        {
+            printf("host command event source failed\n");
+            return HBI_STATUS_INTERNAL_ERR;
+        }
+
+        status = HbiRead(pDev, 0x0032, (uint8_t *)&temp, sizeof(temp));
+        CHK_STATUS(status);
+        if (temp == 0) /* HOST_CMD_IDLE */
+        {
+            return HBI_STATUS_SUCCESS;
+        }
+        if (remain == 0)
+        {
+            return HBI_STATUS_OP_INCOMPLETE;
+        }
+    }
+}
+
+/* default poll schedule, a few back to back polls for commands that complete
+   within a bus transaction or two, then sleep 20 us doubling up to 10 ms */
+static const HbiPollCfg pollCfgDefault =
+{
+    8,                        /* fastPolls */
+    20,                       /* minSleepUs */
+    10000,                    /* maxSleepUs */
+    HBI_HOST_CMD_TIMEOUT_MS   /* timeoutMs */
+};
+
+/*********************************************************************************/
+/*  Description: poll register reg until ((value read & mask) == val) equals    */
+/*  match. Polls are issued back to back first and then with an exponentially    */
+/*  growing sleep in between, bounded by a hard deadline. Returns                */
+/*  HBI_STATUS_OP_INCOMPLETE if the deadline passes. The last value read is      */
+/*  returned in pVal if not NULL. pCfg NULL selects the default schedule.        */
+/*********************************************************************************/
+HbiStatus HbiPollReg(HbiDevice *pDev, uint16_t reg, uint16_t mask, uint16_t val, bool match,
+    HbiPollCfg const *pCfg, uint16_t *pVal)
+{
+    HbiStatus status;
+    struct timespec deadline, now;
+    uint64_t remainUs;
+    uint16_t temp = 0;
+    uint32_t polls = 0;
+    uint32_t sleepUs;
+
+    if (pCfg == NULL)
+    {
+        pCfg = &pollCfgDefault;
+    }
+    sleepUs = pCfg->minSleepUs;
+    HbiPortTimeAfter(&deadline, (uint64_t)pCfg->timeoutMs * 1000);
+
+    for (;;)
+    {
+        /* the register is expected to change, never answer from the shadow */
+        status = HbiReadFrame(pDev, reg, (uint8_t *)&temp, sizeof(temp), false);
+        HbiBusLock(pDev);
+        pDev->stats.polls++;
+        HbiBusUnlock(pDev);
+        if (pVal)
+        {
+            *pVal = temp;
+        }
+        if (status != HBI_STATUS_SUCCESS)
+        {
+            return status;
+        }
+        if (((temp & mask) == val) == match)
+        {
+            return HBI_STATUS_SUCCESS;
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if ((now.tv_sec > deadline.tv_sec) ||
+            ((now.tv_sec == deadline.tv_sec) && (now.tv_nsec >= deadline.tv_nsec)))
+        {
+            return HBI_STATUS_OP_INCOMPLETE;
+        }
+
+        if (++polls > pCfg->fastPolls)
+        {
+            /* never sleep past the deadline, the last poll happens on it */
+            remainUs = (uint64_t)(deadline.tv_sec - now.tv_sec) * 1000000 +
+                (deadline.tv_nsec - now.tv_nsec) / 1000;
+            HbiBusLock(pDev);
+            pDev->stats.pollSleeps++;
+            HbiBusUnlock(pDev);
+            HbiPortDelayUs(pDev, (sleepUs < remainUs) ? sleepUs : (uint32_t)remainUs);
+
+            sleepUs <<= 1;
+            if (sleepUs > pCfg->maxSleepUs)
+            {
+                sleepUs = pCfg->maxSleepUs;
+            }
+        }
+    }
+}
+
+/* HbiWriteHostCmd() holding the command lock */
+static HbiStatus HbiWriteHostCmdLocked(HbiDevice *pDev, uint16_t cmd)
+{
+    HbiStatus status = HBI_STATUS_SUCCESS;
+    uint16_t  notice = 0x1;
+    HbiBatch  batch;
+    HbiEventSource *pEvent = pDev->pEvent;
+    /* check whether there's any ongoing command */
+    status = HbiPollReg(pDev, 0x0006, 0x1, 0x0, true, NULL, NULL);
+    if (status == HBI_STATUS_OP_INCOMPLETE)
+    {
+        return HBI_STATUS_RESOURCE_ERR;
+    }
+    CHK_STATUS(status);
+
+    if (pEvent)
+    {
+        HbiEventDrain(pEvent);
+    }
+
+    /* write the command into the Host Command register and issue
+       "Host Command Written" notice to firmware in one bus transaction */
+    status = HbiBatchBegin(pDev, &batch);
+    CHK_STATUS(status);
+
+    /*0x0032:  Host Command register*/
+    status = HbiBatchAppendWrite(&batch, 0x0032, (uint8_t *)&cmd, sizeof(cmd));
+    if (status == HBI_STATUS_SUCCESS)
+    {
+        status = HbiBatchAppendWrite(&batch, 0x0006, (uint8_t *)&notice, sizeof(notice));
+    }
+    if (status == HBI_STATUS_SUCCESS)
+    {
+        status = HbiBatchSubmit(&batch);
+    }
+    HbiBatchEnd(&batch);
+    CHK_STATUS(status);
+
+    /* check whether the last command is completed */
+    if (pEvent)
+    {
+        status = HbiWaitHostCmdEvent(pDev, pEvent);
+    }
+    else
+    {
+        status = HbiPollReg(pDev, 0x0032, 0xFFFF, 0x0000 /* HOST_CMD_IDLE */, true, NULL, NULL);
+    }
+    if (status == HBI_STATUS_OP_INCOMPLETE)
+    {
+        return HBI_STATUS_RESOURCE_ERR;
+    }
+
+    return status;
+}
+
+/*********************************************************************************/
+/*    Writing a host command into Command register and processing it             */
+/*     is a 3-step process                                                       */
+/*     1. check if there's any command in process by monitoring sw flag regs.    */
+/*     if yes, wait for it to compelete                                          */
+/*     2. if no command in progress, then write current command in to command    */
+/*     register and issue notice to firmware that a host command is written      */
+/*     3. wait for current command to complete                                   */
+/*********************************************************************************/
+HbiStatus HbiWriteHostCmd(HbiDevice *pDev, uint16_t cmd)
+{
+    HbiStatus status;
+    uint64_t start = HbiStatsNowNs();
+
+    if (pDev == NULL)
+    {
+        return HBI_STATUS_INVALID_ARG;
+    }
+
+    /* the bus is only locked for each access, other threads keep using the
+       device while the command executes */
+    pthread_mutex_lock(&pDev->cmdLock);
+    status = HbiWriteHostCmdLocked(pDev, cmd);
+
+    /* the firmware may have changed any register while executing it */
+    HbiBusLock(pDev);
+    HbiCacheInvalidate(pDev->pCache);
+    pDev->stats.hostCmds++;
+    if (status != HBI_STATUS_SUCCESS)
+    {
+        pDev->stats.hostCmdErrors++;
+    }
+    HbiStatsRecord(&pDev->stats, HBI_STATS_HOST_CMD, start);
+    HbiBusUnlock(pDev);
+    pthread_mutex_unlock(&pDev->cmdLock);
+    return status;
+}
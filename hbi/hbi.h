@@ -28,6 +28,9 @@
 #ifndef __HBI_H__
 #define __HBI_H__
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
 
 /*! \brief enumerates various status codes of HBI Driver
  *
@@ -76,8 +79,16 @@ typedef enum
 #define HBI_DEV_ENDIAN_BIG                     0
 #define HBI_DEV_ENDIAN_LITTLE                  1
 
-/*Assuming host is little endian. user needs to set the host endianess here. */
-#define HOST_ENDIAN_LITTLE                     1 
+/* Host endianness, taken from the compiler. Define HOST_ENDIAN_LITTLE on the
+   command line for compilers that don't report it. */
+#ifndef HOST_ENDIAN_LITTLE
+#if defined(__BYTE_ORDER__) && defined(__ORDER_BIG_ENDIAN__) && \
+    (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+#define HOST_ENDIAN_LITTLE                     0
+#else
+#define HOST_ENDIAN_LITTLE                     1
+#endif
+#endif
 
 /* Macro that helps identifying host and device endian compatibility */
 #if (HOST_ENDIAN_LITTLE)
@@ -97,21 +108,503 @@ typedef enum
            printf("ERROR %d: \n", status); \
            return status; \
                                      } 
-bool HbiPortOpen(int32_t *fd);
 
-void HbiPortClose(int32_t fd);
+/*! \brief handle of an open ZL380xx device, see HbiPortOpen()
+ *
+ */
+typedef struct HbiDevice HbiDevice;
+
+typedef struct HbiBatch HbiBatch;
+
+/*! \brief bus backend of a device. Backends other than the ones provided
+ *  include hbi_port.h for the device fields. writeFrame, batch, delay and
+ *  setSpeed are optional, the driver falls back to write/read and sleeping
+ *  when NULL and clock changes then only take effect per transfer.
+ */
+typedef struct
+{
+    const char *name;
+    bool (*open)(HbiDevice *pDev);
+    void (*close)(HbiDevice *pDev);
+    bool (*read)(HbiDevice *pDev, void *pSrc, void *pDst, size_t nread, size_t nwrite);
+    bool (*write)(HbiDevice *pDev, uint8_t const *tx, uint8_t const *rx, size_t len);
+    bool (*writeFrame)(HbiDevice *pDev, uint8_t const *hdr, size_t nhdr,
+        uint8_t const *data, size_t ndata);
+    bool (*batch)(HbiDevice *pDev, HbiBatch *pBatch);
+    void (*delay)(HbiDevice *pDev, uint32_t usec);
+    bool (*setSpeed)(HbiDevice *pDev);  /* pDev->speed or bulkSpeed changed */
+}HbiTransport;
+
+/* transports provided by the driver */
+extern const HbiTransport hbiSpiTransport;
+extern const HbiTransport hbiI2cTransport;
+extern const HbiTransport hbiSimTransport;
+
+/*! \brief bus settings used to open a device. Zero/NULL fields select the
+ *  driver defaults.
+ */
+typedef struct
+{
+    HbiTransport const *pTransport; /*!< bus backend, NULL picks I2C for /dev/i2c* nodes, the
+                                         simulator for "sim" and SPI otherwise */
+    const char *path;     /*!< bus device node, e.g. "/dev/spidev0.0" or "/dev/i2c-1" */
+    uint32_t    speed;    /*!< SPI clock in Hz */
+    uint32_t    bulkSpeed; /*!< SPI clock for transfers of HBI_BULK_MIN_BYTES or more, 0 for speed */
+    uint32_t    mode;     /*!< SPI mode */
+    uint8_t     bits;     /*!< SPI bits per word */
+    uint16_t    i2cAddr;  /*!< I2C slave address of the device */
+    const char *capturePath; /*!< capture all frames to this file, see HbiCaptureStart().
+                                  NULL uses the HBI_CAPTURE environment variable if set */
+    uint32_t    bufSize;  /*!< size of the pool transfer buffers, 0 for the bus limit */
+    uint32_t    numBufs;  /*!< number of pool transfer buffers, 0 for HBI_BUF_POOL_DEFAULT */
+    uint32_t    maxMsg;   /*!< largest bus message, 0 for the bus limit: the spidev bufsiz
+                               read from sysfs or the i2c-dev maximum. Set it for I2C
+                               adapters with a smaller limit or to override bufsiz */
+}HbiDeviceCfg;
+
+/* Every device owns a pool of transfer buffers, allocated once when it is
+ * opened and handed out by HbiBufGet(). Buffers start on a cache line and
+ * are as large as one bus message (HbiDeviceCfg.maxMsg, e.g. the spidev
+ * bufsiz) unless HbiDeviceCfg.bufSize says otherwise. HBI_SPIDEV_BUFSIZ is
+ * the kernel default, used when the bus reports no limit.
+ */
+#define HBI_CACHE_LINE                         64
+#define HBI_SPIDEV_BUFSIZ                      4096
+
+/* spidev rounds every transfer of a message up to the DMA alignment of the
+ * host (ARCH_DMA_MINALIGN, up to 128 bytes on arm64) before it checks the
+ * message against bufsiz. The SPI transport counts its transfers the same
+ * way, with HBI_SPIDEV_ALIGN covering every host.
+ */
+#define HBI_SPIDEV_ALIGN                       128
+#define HBI_BUF_POOL_DEFAULT                   4
+#define HBI_BUF_POOL_MAX                       32
+
+/* Frames carrying at least this many bytes (header and data) are bulk
+ * transfers, e.g. image blocks, and are clocked at the bulk SPI clock.
+ * Smaller command and status frames use the normal clock.
+ */
+#define HBI_BULK_MIN_BYTES                     64
+
+/* Largest payload sent in one HBI frame by the block functions. A paged
+ * access can cover a whole 256-byte page, lower this for buses that can not
+ * carry that much in one message; pages are then completed with continuous
+ * paged write frames instead of re-sending page select and offset.
+ */
+#define HBI_MAX_FRAME_PAYLOAD                  256
+
+/* An HbiBatch holds as many bytes as the bus carries in one message
+ * (HbiBatchMaxBytes(), the spidev bufsiz or HbiDeviceCfg.maxMsg), counted
+ * the way the bus counts them (HbiBatchFrameBytes()), so a full batch still
+ * fits in a single SPI_IOC_MESSAGE. It has a frame (one chip-select
+ * assertion) for every HBI_BATCH_FRAME_BYTES of that, but never fewer than
+ * HBI_BATCH_MIN_FRAMES.
+ */
+#define HBI_BATCH_FRAME_BYTES                  128
+#define HBI_BATCH_MIN_FRAMES                   32
+
+/* Storage for this many batches is part of the transfer buffer pool of a
+ * device, so batches live at the same time (e.g. the async worker and a
+ * caller) don't allocate. Any batch beyond that is allocated on begin.
+ */
+#define HBI_BATCH_POOL                         4
+
+/*! \brief one queued HBI frame of a batch
+ *
+ */
+typedef struct
+{
+    uint8_t const *tx; /*!< frame header (and write payload), in batch buffer or caller's for raw frames */
+    size_t   txLen;    /*!< number of bytes to send */
+    uint8_t *rx;       /*!< caller buffer for read data, NULL for write frames */
+    size_t   rxLen;    /*!< number of bytes to read */
+    uint16_t reg;      /*!< first register accessed by the frame */
+    size_t   size;     /*!< number of bytes written or read, 0 for raw frames */
+}HbiBatchFrame;
+
+/*! \brief collects HBI reads/writes to be sent in a single bus transaction
+ *
+ */
+struct HbiBatch
+{
+    HbiDevice     *pDev;
+    uint8_t        page;     /*!< page selected by the frames queued so far, 0 if unknown */
+    bool           raw;      /*!< raw frames queued, device state unknown after submit */
+    int32_t        numFrames;
+    int32_t        maxFrames; /*!< size of frame[] */
+    size_t         txUsed;   /*!< bytes used in buf */
+    size_t         wireLen;  /*!< total tx + rx bytes queued */
+    size_t         msgUsed;  /*!< bytes queued as counted against maxBytes, see HbiBatchFrameBytes() */
+    size_t         maxBytes; /*!< bytes a batch may hold, size of buf */
+    HbiBatchFrame *frame;    /*!< storage taken by HbiBatchBegin(), given back by HbiBatchEnd() */
+    uint8_t       *buf;
+};
+
+/*! \brief schedule used by HbiPollReg() to wait for a register condition
+ *
+ */
+typedef struct
+{
+    uint32_t fastPolls;   /*!< polls issued back to back before sleeping */
+    uint32_t minSleepUs;  /*!< first sleep between polls, doubled on every poll */
+    uint32_t maxSleepUs;  /*!< upper bound of the sleep between polls */
+    uint32_t timeoutMs;   /*!< hard deadline for the condition to become true */
+}HbiPollCfg;
+
+/*! \brief pollable source of device interrupts used to detect host command
+ *  completion. Any descriptor that becomes readable when the device raises
+ *  its interrupt can be used, e.g. a GPIO line event or an eventfd.
+ */
+typedef struct HbiEventSource HbiEventSource;
+struct HbiEventSource
+{
+    int32_t fd;                            /*!< descriptor polled for POLLIN */
+    bool  (*ack)(HbiEventSource *pSrc);    /*!< consumes one event, NULL reads from fd */
+    void   *pUser;                         /*!< free for use by a custom ack */
+};
+
+/*! \brief behaviour of a simulated device (hbiSimTransport)
+ *
+ */
+typedef struct
+{
+    uint32_t speed;          /*!< SPI clock in Hz used to model wire time, 0 to transfer instantly */
+    uint32_t xferOverheadUs; /*!< fixed cost of every bus transaction when speed is set */
+    uint32_t cmdLatencyUs;   /*!< time taken by a host command or a reset to complete */
+    bool     noFlash;        /*!< behave as if no flash is connected to the device */
+    uint32_t maxSpeed;       /*!< clock above which read data is corrupted, 0 for no limit */
+    uint32_t failBatch;      /*!< batch reported as failed, counted from 1 after HbiSimConfigure(),
+                                  0 for none. Its frames still reach the device */
+}HbiSimCfg;
+
+/*! \brief traffic seen by a simulated device
+ *
+ */
+typedef struct
+{
+    uint64_t transactions; /*!< bus transactions (ioctl calls on real hardware) */
+    uint64_t frames;       /*!< chip select assertions */
+    uint64_t txBytes;
+    uint64_t rxBytes;
+    uint64_t wireNs;       /*!< modelled bus time, 0 unless a speed is configured */
+    uint64_t hostCmds;     /*!< host commands executed */
+}HbiSimStats;
+
+/*! \brief operations that can be queued to the I/O thread of a device
+ *
+ */
+typedef enum
+{
+    HBI_ASYNC_READ,     /*!< HbiReadBlock() of size bytes at reg into buf */
+    HBI_ASYNC_WRITE,    /*!< HbiWriteBlock() of size bytes from buf to reg */
+    HBI_ASYNC_HOST_CMD  /*!< HbiWriteHostCmd() of command reg, result register returned */
+}HbiAsyncOp;
+
+/*! \brief asynchronous request, see HbiAsyncSubmit()
+ *
+ */
+typedef struct
+{
+    HbiAsyncOp op;
+    uint16_t   reg;       /*!< register address, or host command for HBI_ASYNC_HOST_CMD */
+    uint8_t   *buf;       /*!< data buffer, must stay valid until completion */
+    size_t     size;      /*!< number of bytes to transfer */
+    uint64_t   userData;  /*!< returned unchanged in the completion */
+}HbiAsyncReq;
+
+/*! \brief result of an asynchronous request
+ *
+ */
+typedef struct
+{
+    uint64_t  userData;
+    HbiStatus status;
+    uint16_t  result;     /*!< host command result register (0x0034), 0 for reads/writes */
+}HbiAsyncCompletion;
+
+/*! \brief I/O thread and its rings, see HbiAsyncOpen()
+ *
+ */
+typedef struct HbiAsync HbiAsync;
+
+/*! \brief inclusive range of register addresses
+ *
+ */
+typedef struct
+{
+    uint16_t first;
+    uint16_t last;
+}HbiRegRange;
+
+/*! \brief register shadow settings, see HbiCacheEnable()
+ *
+ */
+typedef struct
+{
+    HbiRegRange const *pVolatile;   /*!< registers changed by the device, NULL for the defaults */
+    uint32_t           numVolatile;
+    uint32_t           readAhead;   /*!< bytes read on a miss, up to the page end, 0 to read exactly */
+}HbiCacheCfg;
+
+/* Maximum number of updates passed to one HbiUpdateBitsMulti() call */
+#define HBI_UPDATE_MAX_REGS                    64
+
+/*! \brief masked update of one register, see HbiUpdateBitsMulti()
+ *
+ */
+typedef struct
+{
+    uint16_t reg;   /*!< register address */
+    uint16_t mask;  /*!< bits to change */
+    uint16_t val;   /*!< new value of the bits in mask */
+}HbiBitUpdate;
+
+/* Number of buckets of a latency histogram, bucket i counts 2^i to 2^(i+1) ns */
+#define HBI_STATS_BUCKETS                      32
+
+/*! \brief operations timed by the driver, see HbiStats
+ *
+ */
+typedef enum
+{
+    HBI_STATS_READ,      /*!< HbiRead(), including reads served by the register cache */
+    HBI_STATS_WRITE,     /*!< HbiWrite() */
+    HBI_STATS_HOST_CMD,  /*!< HbiWriteHostCmd(), from issue to completion */
+    HBI_STATS_DELAY,     /*!< HbiPortDelay() and HbiPortDelayUs(), time actually slept */
+    HBI_STATS_NUM_OPS
+}HbiStatsOp;
+
+/*! \brief log2 bucketed latency histogram
+ *
+ */
+typedef struct
+{
+    uint64_t count;
+    uint64_t totalNs;
+    uint64_t minNs;
+    uint64_t maxNs;
+    uint64_t bucket[HBI_STATS_BUCKETS];
+}HbiHistogram;
+
+/*! \brief performance counters of a device, see HbiStatsGet()
+ *
+ */
+typedef struct
+{
+    uint64_t transactions;     /*!< bus transactions (ioctl calls) */
+    uint64_t frames;           /*!< chip select assertions or I2C messages */
+    uint64_t txBytes;          /*!< all bytes sent, including raw streams */
+    uint64_t rxBytes;
+    uint64_t payloadBytes;     /*!< register data moved by reads and writes */
+    uint64_t overheadBytes;    /*!< command words and page selects of reads and writes */
+    uint64_t pageSelects;      /*!< page select commands sent */
+    uint64_t pageSelectsSaved; /*!< paged accesses that reused the selected page */
+    uint64_t cacheHits;        /*!< HbiRead() calls served by the register cache */
+    uint64_t cacheMisses;
+    uint64_t writesSkipped;    /*!< HbiUpdateBits() writes dropped as no-ops, the read is saved only on a cache hit */
+    uint64_t hostCmds;
+    uint64_t hostCmdErrors;
+    uint64_t polls;            /*!< register reads made by HbiPollReg() */
+    uint64_t pollSleeps;       /*!< waits between HbiPollReg() reads */
+    uint64_t errors;           /*!< failed bus transactions */
+    uint64_t busNs;            /*!< time spent in bus transactions, for the throughput */
+    HbiHistogram latency[HBI_STATS_NUM_OPS];
+}HbiStats;
+
+/* Bytes of every frame kept in a trace record, transmitted bytes first */
+#define HBI_TRACE_DATA_BYTES                   40
+#define HBI_TRACE_MAGIC                        "HBIT"
+#define HBI_TRACE_VERSION                      1
+
+/* trace record flags */
+#define HBI_TRACE_F_ERROR                      0x01 /* transaction failed */
+#define HBI_TRACE_F_BATCH                      0x02 /* frame of a multi frame transaction */
+#define HBI_TRACE_F_RAW                        0x04 /* raw stream from HbiPortWrite() */
+
+/*! \brief one traced frame, see HbiTraceEnable()
+ *
+ */
+typedef struct
+{
+    uint64_t startNs;  /*!< CLOCK_MONOTONIC time the transaction started */
+    uint32_t durNs;    /*!< duration of the whole transaction */
+    uint32_t seq;      /*!< frame number since tracing was enabled */
+    uint16_t txLen;    /*!< bytes sent in this frame */
+    uint16_t rxLen;    /*!< bytes received in this frame */
+    uint8_t  flags;    /*!< HBI_TRACE_F_* */
+    uint8_t  nTx;      /*!< sent bytes captured in data */
+    uint8_t  nRx;      /*!< received bytes captured in data after them */
+    uint8_t  reserved;
+    uint8_t  data[HBI_TRACE_DATA_BYTES];
+}HbiTraceRec;
+
+/*! \brief header preceding the records of every HbiTraceFlush() in a trace file
+ *
+ */
+typedef struct
+{
+    char     magic[4];   /*!< HBI_TRACE_MAGIC */
+    uint16_t version;    /*!< HBI_TRACE_VERSION */
+    uint16_t recSize;    /*!< sizeof(HbiTraceRec) */
+    uint32_t count;      /*!< records that follow */
+    uint32_t dropped;    /*!< records overwritten before they could be flushed */
+}HbiTraceFileHdr;
+
+#define HBI_CAPTURE_MAGIC                      "HBIC"
+#define HBI_CAPTURE_VERSION                    1
+
+/*! \brief header of a capture file, followed by HbiCaptureRec records
+ *
+ */
+typedef struct
+{
+    char     magic[4];   /*!< HBI_CAPTURE_MAGIC */
+    uint16_t version;    /*!< HBI_CAPTURE_VERSION */
+    uint16_t recSize;    /*!< sizeof(HbiCaptureRec) */
+}HbiCaptureFileHdr;
+
+/*! \brief one captured frame, followed by the txLen bytes sent
+ *
+ */
+typedef struct
+{
+    uint64_t startNs;  /*!< CLOCK_MONOTONIC time the transaction started */
+    uint32_t durNs;    /*!< duration of the whole transaction */
+    uint32_t xfer;     /*!< bus transaction number, shared by the frames of a batch */
+    uint16_t txLen;    /*!< bytes sent */
+    uint16_t rxLen;    /*!< bytes received, not stored */
+    uint8_t  flags;    /*!< HBI_TRACE_F_* */
+    uint8_t  reserved[3];
+}HbiCaptureRec;
+
+/*! \brief SPI clock calibration settings, see HbiSpiCalibrate(). Zero fields
+ *  select the defaults.
+ */
+typedef struct
+{
+    uint32_t minSpeed;    /*!< first clock tried, default 1 MHz */
+    uint32_t maxSpeed;    /*!< last clock tried, default 50 MHz */
+    uint32_t stepPct;     /*!< clock increase per step in percent, default 10 */
+    uint32_t marginPct;   /*!< result is this much below the fastest good clock, default 20 */
+    uint32_t rounds;      /*!< pattern rounds that must pass at a clock, default 8 */
+    uint16_t reg;         /*!< first register of a scratch range, restored afterwards.
+                               0 selects the page 255 base address 0x000C */
+    uint16_t size;        /*!< size of the scratch range in bytes, default 4 */
+}HbiSpiCalCfg;
+
+bool HbiPortOpen(HbiDevice **ppDev, HbiDeviceCfg const *pCfg);
+
+void HbiPortClose(HbiDevice *pDev);
+
+bool HbiPortWrite(HbiDevice *pDev, uint8_t const *tx, uint8_t const *rx, size_t len);
+
+bool HbiPortRead(HbiDevice *pDev, void *pSrc, void *pDst, size_t nread, size_t nwrite);
+
+bool HbiPortWriteFrame(HbiDevice *pDev, uint8_t const *hdr, size_t nhdr,
+    uint8_t const *data, size_t ndata);
+
+bool HbiPortBatch(HbiDevice *pDev, HbiBatch *pBatch);
+
+HbiStatus HbiEraseFlash(HbiDevice *pDev);
+
+HbiStatus HbiWrite(HbiDevice *pDev, uint16_t reg, uint8_t const *data, int32_t size);
+
+HbiStatus HbiRead(HbiDevice *pDev, uint16_t reg, uint8_t *buf, int32_t size);
+
+HbiStatus HbiWriteBlock(HbiDevice *pDev, uint16_t reg, uint8_t const *data, size_t size);
+
+HbiStatus HbiReadBlock(HbiDevice *pDev, uint16_t reg, uint8_t *buf, size_t size);
+
+HbiStatus HbiUpdateBits(HbiDevice *pDev, uint16_t reg, uint16_t mask, uint16_t val);
+
+HbiStatus HbiUpdateBitsMulti(HbiDevice *pDev, HbiBitUpdate const *pUpd, int32_t num);
+
+HbiStatus HbiPollReg(HbiDevice *pDev, uint16_t reg, uint16_t mask, uint16_t val, bool match,
+    HbiPollCfg const *pCfg, uint16_t *pVal);
+
+HbiStatus HbiWriteHostCmd(HbiDevice *pDev, uint16_t cmd);
+
+HbiStatus HbiEventOpenGpio(HbiEventSource *pSrc, const char *chip, uint32_t line, bool activeLow);
+
+void HbiEventClose(HbiEventSource *pSrc);
+
+HbiStatus HbiSetEventSource(HbiDevice *pDev, HbiEventSource *pSrc);
+
+void HbiInvalidateCache(HbiDevice *pDev);
+
+HbiStatus HbiCacheEnable(HbiDevice *pDev, HbiCacheCfg const *pCfg);
+
+void HbiCacheDisable(HbiDevice *pDev);
+
+HbiStatus HbiTransactionBegin(HbiDevice *pDev);
+
+HbiStatus HbiTransactionEnd(HbiDevice *pDev);
+
+HbiStatus HbiBatchBegin(HbiDevice *pDev, HbiBatch *pBatch);
+
+HbiStatus HbiBatchAppendWrite(HbiBatch *pBatch, uint16_t reg, uint8_t const *data, int32_t size);
+
+HbiStatus HbiBatchAppendRead(HbiBatch *pBatch, uint16_t reg, uint8_t *buf, int32_t size);
+
+HbiStatus HbiBatchAppendRaw(HbiBatch *pBatch, uint8_t const *data, size_t len);
+
+HbiStatus HbiBatchSubmit(HbiBatch *pBatch);
+
+void HbiBatchEnd(HbiBatch *pBatch);
+
+size_t HbiBatchMaxBytes(HbiDevice *pDev);
+
+int32_t HbiBatchMaxFrames(HbiDevice *pDev);
+
+size_t HbiBatchFrameBytes(HbiDevice *pDev, size_t txLen, size_t rxLen);
+
+void HbiPortDelay(HbiDevice *pDev, int32_t msec /*milliseconds*/);
+
+void HbiPortDelayUs(HbiDevice *pDev, uint32_t usec /*microseconds*/);
+
+void HbiConvertWords(void *dst, void const *src, size_t words);
+
+HbiStatus HbiSimConfigure(HbiDevice *pDev, HbiSimCfg const *pCfg);
+
+HbiStatus HbiSimGetStats(HbiDevice *pDev, HbiSimStats *pStats, bool clear);
+
+HbiStatus HbiSimReadMem(HbiDevice *pDev, uint32_t addr, uint8_t *buf, size_t size);
+
+HbiStatus HbiAsyncOpen(HbiDevice *pDev, uint32_t depth, HbiAsync **ppAsync);
+
+void HbiAsyncClose(HbiAsync *pAsync);
+
+HbiStatus HbiAsyncSubmit(HbiAsync *pAsync, HbiAsyncReq const *pReq);
+
+int32_t HbiAsyncFd(HbiAsync *pAsync);
+
+int32_t HbiAsyncReap(HbiAsync *pAsync, HbiAsyncCompletion *pComp, int32_t max);
+
+HbiStatus HbiStatsGet(HbiDevice *pDev, HbiStats *pStats, bool clear);
+
+void HbiStatsDumpJson(HbiStats const *pStats, FILE *fp);
+
+HbiStatus HbiTraceEnable(HbiDevice *pDev, uint32_t numRecords);
+
+void HbiTraceDisable(HbiDevice *pDev);
+
+HbiStatus HbiTraceFlush(HbiDevice *pDev, FILE *fp);
+
+HbiStatus HbiCaptureStart(HbiDevice *pDev, const char *path);
+
+HbiStatus HbiSetSpiSpeed(HbiDevice *pDev, uint32_t speed, uint32_t bulkSpeed);
 
-bool HbiPortWrite(int32_t fd, uint8_t const *tx, uint8_t const *rx, size_t len);
+HbiStatus HbiSpiCalibrate(HbiDevice *pDev, HbiSpiCalCfg const *pCfg, uint32_t *pSpeed);
 
-bool HbiPortRead(int32_t fd, void *pSrc, void *pDst, size_t nread, size_t nwrite);
+HbiStatus HbiSpiSpeedSave(HbiDevice *pDev, const char *file);
 
-HbiStatus HbiEraseFlash(int32_t fd);
+HbiStatus HbiSpiSpeedLoad(HbiDevice *pDev, const char *file);
 
-HbiStatus HbiWrite(int32_t fd, uint16_t reg, uint8_t *data, int32_t size);
+void HbiCaptureStop(HbiDevice *pDev);
 
-HbiStatus HbiRead(int32_t fd, uint16_t reg, uint8_t *buf, int32_t size);
+void *HbiBufGet(HbiDevice *pDev, size_t size);
 
-HbiStatus HbiWriteHostCmd(int32_t fd, uint16_t cmd);
+void HbiBufPut(HbiDevice *pDev, void *pBuf);
 
-void HbiPortDelay(int32_t msec /*milliseconds*/);
-#endif /* __HBI_H__*/
\ No newline at end of file
+size_t HbiBufSize(HbiDevice *pDev);
+#endif /* __HBI_H__*/
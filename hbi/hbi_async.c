@@ -0,0 +1,436 @@
+/*******************************************************************************
+* Copyright (C) 2021 Microchip Technology Inc. and its subsidiaries.
+*
+* Subject to your compliance with these terms, you may use Microchip software
+* and any derivatives exclusively with Microchip products. It is your
+* responsibility to comply with third party license terms applicable to your
+* use of third party software (including open source software) that may
+* accompany Microchip software.
+*
+* THIS SOFTWARE IS SUPPLIED BY MICROCHIP "AS IS". NO WARRANTIES, WHETHER
+* EXPRESS, IMPLIED OR STATUTORY, APPLY TO THIS SOFTWARE, INCLUDING ANY IMPLIED
+* WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY, AND FITNESS FOR A
+* PARTICULAR PURPOSE.
+*
+* IN NO EVENT WILL MICROCHIP BE LIABLE FOR ANY INDIRECT, SPECIAL, PUNITIVE,
+* INCIDENTAL OR CONSEQUENTIAL LOSS, DAMAGE, COST OR EXPENSE OF ANY KIND
+* WHATSOEVER RELATED TO THE SOFTWARE, HOWEVER CAUSED, EVEN IF MICROCHIP HAS
+* BEEN ADVISED OF THE POSSIBILITY OR THE DAMAGES ARE FORESEEABLE. TO THE
+* FULLEST EXTENT ALLOWED BY LAW, MICROCHIP'S TOTAL LIABILITY ON ALL CLAIMS IN
+* ANY WAY RELATED TO THIS SOFTWARE WILL NOT EXCEED THE AMOUNT OF FEES, IF ANY,
+* THAT YOU HAVE PAID DIRECTLY TO MICROCHIP FOR THIS SOFTWARE.
+*******************************************************************************/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+#include <sched.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/eventfd.h>
+#include "hbi_port.h"
+
+/* Requests are passed to a per-device I/O thread through a submission ring
+ * and handed back through a completion ring. Both rings are bounded
+ * lock-free queues where every slot carries a sequence number telling
+ * producers and consumers whose turn it is, so any number of threads may
+ * submit and reap. The number of requests in flight is capped at the ring
+ * depth, neither ring can overflow.
+ */
+
+typedef struct
+{
+    atomic_size_t seq;
+    union
+    {
+        HbiAsyncReq        req;
+        HbiAsyncCompletion comp;
+    }u;
+}HbiAsyncSlot;
+
+typedef struct
+{
+    HbiAsyncSlot *slot;
+    size_t        mask;
+    atomic_size_t head; /* next slot to fill */
+    atomic_size_t tail; /* next slot to drain */
+}HbiAsyncRing;
+
+struct HbiAsync
+{
+    HbiDevice     *pDev;
+    HbiAsyncRing   sq;
+    HbiAsyncRing   cq;
+    uint32_t       depth;
+    atomic_uint    inflight;    /* submitted and not yet reaped */
+    atomic_bool    idle;        /* worker is about to sleep on kickFd */
+    atomic_bool    stop;
+    int32_t        kickFd;      /* wakes the worker */
+    int32_t        compFd;      /* readable while completions are pending */
+    pthread_t      thread;
+};
+
+static bool HbiAsyncRingInit(HbiAsyncRing *pRing, uint32_t depth)
+{
+    size_t i;
+
+    pRing->slot = calloc(depth, sizeof(HbiAsyncSlot));
+    if (pRing->slot == NULL)
+    {
+        return false;
+    }
+    for (i = 0; i < depth; i++)
+    {
+        atomic_init(&pRing->slot[i].seq, i);
+    }
+    pRing->mask = depth - 1;
+    atomic_init(&pRing->head, 0);
+    atomic_init(&pRing->tail, 0);
+    return true;
+}
+
+/* claim the next free slot, NULL if the ring is full */
+static HbiAsyncSlot *HbiAsyncRingClaim(HbiAsyncRing *pRing, size_t *pPos)
+{
+    HbiAsyncSlot *pSlot;
+    size_t pos = atomic_load_explicit(&pRing->head, memory_order_relaxed);
+    intptr_t diff;
+
+    for (;;)
+    {
+        pSlot = &pRing->slot[pos & pRing->mask];
+        diff = (intptr_t)atomic_load_explicit(&pSlot->seq, memory_order_acquire) - (intptr_t)pos;
+        if (diff == 0)
+        {
+            if (atomic_compare_exchange_weak_explicit(&pRing->head, &pos, pos + 1,
+                memory_order_relaxed, memory_order_relaxed))
+            {
+                *pPos = pos;
+                return pSlot;
+            }
+        }
+        else if (diff < 0)
+        {
+            return NULL;
+        }
+        else
+        {
+            pos = atomic_load_explicit(&pRing->head, memory_order_relaxed);
+        }
+    }
+}
+
+/* claim a slot of a ring that is known to have room. A slot may still be
+   held for a moment by the consumer that drained it */
+static HbiAsyncSlot *HbiAsyncRingClaimWait(HbiAsyncRing *pRing, size_t *pPos)
+{
+    HbiAsyncSlot *pSlot;
+
+    while ((pSlot = HbiAsyncRingClaim(pRing, pPos)) == NULL)
+    {
+        sched_yield();
+    }
+    return pSlot;
+}
+
+/* make a filled slot visible to consumers */
+static void HbiAsyncRingPublish(HbiAsyncSlot *pSlot, size_t pos)
+{
+    atomic_store_explicit(&pSlot->seq, pos + 1, memory_order_release);
+}
+
+/* take the oldest filled slot, NULL if the ring is empty */
+static HbiAsyncSlot *HbiAsyncRingTake(HbiAsyncRing *pRing, size_t *pPos)
+{
+    HbiAsyncSlot *pSlot;
+    size_t pos = atomic_load_explicit(&pRing->tail, memory_order_relaxed);
+    intptr_t diff;
+
+    for (;;)
+    {
+        pSlot = &pRing->slot[pos & pRing->mask];
+        diff = (intptr_t)atomic_load_explicit(&pSlot->seq, memory_order_acquire) - (intptr_t)(pos + 1);
+        if (diff == 0)
+        {
+            if (atomic_compare_exchange_weak_explicit(&pRing->tail, &pos, pos + 1,
+                memory_order_relaxed, memory_order_relaxed))
+            {
+                *pPos = pos;
+                return pSlot;
+            }
+        }
+        else if (diff < 0)
+        {
+            return NULL;
+        }
+        else
+        {
+            pos = atomic_load_explicit(&pRing->tail, memory_order_relaxed);
+        }
+    }
+}
+
+/* hand a drained slot back to producers */
+static void HbiAsyncRingRelease(HbiAsyncRing *pRing, HbiAsyncSlot *pSlot, size_t pos)
+{
+    atomic_store_explicit(&pSlot->seq, pos + pRing->mask + 1, memory_order_release);
+}
+
+static void HbiAsyncSignal(int32_t fd)
+{
+    uint64_t one = 1;
+
+    while ((write(fd, &one, sizeof(one)) < 0) && (errno == EINTR))
+    {
+    }
+}
+
+/* execute one request on the device */
+static void HbiAsyncExec(HbiAsync *pAsync, HbiAsyncReq const *pReq, HbiAsyncCompletion *pComp)
+{
+    HbiDevice *pDev = pAsync->pDev;
+
+    pComp->userData = pReq->userData;
+    pComp->result = 0;
+
+    switch (pReq->op)
+    {
+    case HBI_ASYNC_READ:
+        pComp->status = HbiReadBlock(pDev, pReq->reg, pReq->buf, pReq->size);
+        break;
+    case HBI_ASYNC_WRITE:
+        pComp->status = HbiWriteBlock(pDev, pReq->reg, pReq->buf, pReq->size);
+        break;
+    case HBI_ASYNC_HOST_CMD:
+        /* the result is read before any other host command can replace it,
+           the bus stays free for other users while the command executes */
+        pthread_mutex_lock(&pDev->cmdLock);
+        pComp->status = HbiWriteHostCmd(pDev, pReq->reg);
+        if (pComp->status == HBI_STATUS_SUCCESS)
+        {
+            /*0x0034 Host Command Param/Result register*/
+            pComp->status = HbiRead(pDev, 0x0034, (uint8_t *)&pComp->result,
+                sizeof(pComp->result));
+        }
+        pthread_mutex_unlock(&pDev->cmdLock);
+        break;
+    default:
+        pComp->status = HBI_STATUS_INVALID_ARG;
+        break;
+    }
+}
+
+/* I/O thread, serves the submission ring in order until stopped */
+static void *HbiAsyncWorker(void *pArg)
+{
+    HbiAsync *pAsync = pArg;
+    HbiAsyncSlot *pSlot, *pCompSlot;
+    HbiAsyncReq req;
+    size_t pos, compPos;
+    uint64_t count;
+
+    for (;;)
+    {
+        pSlot = HbiAsyncRingTake(&pAsync->sq, &pos);
+        if (pSlot == NULL)
+        {
+            if (atomic_load(&pAsync->stop))
+            {
+                break;
+            }
+            /* announce the sleep first, then look again so a request
+               submitted in between is not missed */
+            atomic_store(&pAsync->idle, true);
+            atomic_thread_fence(memory_order_seq_cst);
+            pSlot = HbiAsyncRingTake(&pAsync->sq, &pos);
+            if ((pSlot == NULL) && !atomic_load(&pAsync->stop))
+            {
+                while ((read(pAsync->kickFd, &count, sizeof(count)) < 0) && (errno == EINTR))
+                {
+                }
+            }
+            atomic_store(&pAsync->idle, false);
+            if (pSlot == NULL)
+            {
+                continue;
+            }
+        }
+
+        req = pSlot->u.req;
+        HbiAsyncRingRelease(&pAsync->sq, pSlot, pos);
+
+        /* in flight requests never exceed the ring depth, there is room */
+        pCompSlot = HbiAsyncRingClaimWait(&pAsync->cq, &compPos);
+        HbiAsyncExec(pAsync, &req, &pCompSlot->u.comp);
+        HbiAsyncRingPublish(pCompSlot, compPos);
+        HbiAsyncSignal(pAsync->compFd);
+    }
+    return NULL;
+}
+
+/*********************************************************************************/
+/*  Description: start an I/O thread for pDev. depth is the maximum number of    */
+/*  requests in flight and must be a power of two. The synchronous API stays     */
+/*  usable on pDev alongside the asynchronous one.                               */
+/*********************************************************************************/
+HbiStatus HbiAsyncOpen(HbiDevice *pDev, uint32_t depth, HbiAsync **ppAsync)
+{
+    HbiAsync *pAsync;
+
+    if (pDev == NULL)
+    {
+        return HBI_STATUS_BAD_HANDLE;
+    }
+    if ((ppAsync == NULL) || (depth == 0) || (depth & (depth - 1)))
+    {
+        return HBI_STATUS_INVALID_ARG;
+    }
+    pAsync = calloc(1, sizeof(HbiAsync));
+    if (pAsync == NULL)
+    {
+        return HBI_STATUS_RESOURCE_ERR;
+    }
+    pAsync->pDev = pDev;
+    pAsync->depth = depth;
+    atomic_init(&pAsync->inflight, 0);
+    atomic_init(&pAsync->idle, false);
+    atomic_init(&pAsync->stop, false);
+    pAsync->kickFd = eventfd(0, EFD_CLOEXEC);
+    pAsync->compFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+
+    if ((pAsync->kickFd < 0) || (pAsync->compFd < 0) ||
+        !HbiAsyncRingInit(&pAsync->sq, depth) || !HbiAsyncRingInit(&pAsync->cq, depth))
+    {
+        printf("can't allocate async rings\n");
+        goto err;
+    }
+    if (pthread_create(&pAsync->thread, NULL, HbiAsyncWorker, pAsync) != 0)
+    {
+        printf("can't start async worker\n");
+        goto err;
+    }
+
+    *ppAsync = pAsync;
+    return HBI_STATUS_SUCCESS;
+
+err:
+    if (pAsync->kickFd >= 0)
+    {
+        close(pAsync->kickFd);
+    }
+    if (pAsync->compFd >= 0)
+    {
+        close(pAsync->compFd);
+    }
+    free(pAsync->sq.slot);
+    free(pAsync->cq.slot);
+    free(pAsync);
+    return HBI_STATUS_RESOURCE_ERR;
+}
+
+/*********************************************************************************/
+/*  Description: stop the I/O thread once all submitted requests have executed   */
+/*  and free the rings. Completions not reaped are dropped.                      */
+/*********************************************************************************/
+void HbiAsyncClose(HbiAsync *pAsync)
+{
+    if (pAsync == NULL)
+    {
+        return;
+    }
+    atomic_store(&pAsync->stop, true);
+    HbiAsyncSignal(pAsync->kickFd);
+    pthread_join(pAsync->thread, NULL);
+
+    close(pAsync->kickFd);
+    close(pAsync->compFd);
+    free(pAsync->sq.slot);
+    free(pAsync->cq.slot);
+    free(pAsync);
+}
+
+/*********************************************************************************/
+/*  Description: queue a request without blocking. Buffers referenced by pReq    */
+/*  must stay valid until its completion is reaped. Returns                      */
+/*  HBI_STATUS_RESOURCE_ERR if depth requests are already in flight.             */
+/*********************************************************************************/
+HbiStatus HbiAsyncSubmit(HbiAsync *pAsync, HbiAsyncReq const *pReq)
+{
+    HbiAsyncSlot *pSlot;
+    size_t pos;
+
+    if (pAsync == NULL)
+    {
+        return HBI_STATUS_BAD_HANDLE;
+    }
+    if ((pReq == NULL) || ((pReq->op != HBI_ASYNC_HOST_CMD) && (pReq->buf == NULL)))
+    {
+        return HBI_STATUS_INVALID_ARG;
+    }
+    if (atomic_fetch_add(&pAsync->inflight, 1) >= pAsync->depth)
+    {
+        atomic_fetch_sub(&pAsync->inflight, 1);
+        return HBI_STATUS_RESOURCE_ERR;
+    }
+
+    pSlot = HbiAsyncRingClaimWait(&pAsync->sq, &pos);
+    pSlot->u.req = *pReq;
+    HbiAsyncRingPublish(pSlot, pos);
+    atomic_thread_fence(memory_order_seq_cst);
+
+    /* the worker only needs a wake up if it is going to sleep */
+    if (atomic_load(&pAsync->idle))
+    {
+        HbiAsyncSignal(pAsync->kickFd);
+    }
+    return HBI_STATUS_SUCCESS;
+}
+
+/*********************************************************************************/
+/*  Description: descriptor that polls readable while completions are waiting   */
+/*  to be reaped, for use with poll/epoll                                        */
+/*********************************************************************************/
+int32_t HbiAsyncFd(HbiAsync *pAsync)
+{
+    return pAsync ? pAsync->compFd : -1;
+}
+
+/*********************************************************************************/
+/*  Description: move up to max completions into pComp without blocking.        */
+/*  Returns the number of completions reaped.                                    */
+/*********************************************************************************/
+int32_t HbiAsyncReap(HbiAsync *pAsync, HbiAsyncCompletion *pComp, int32_t max)
+{
+    HbiAsyncSlot *pSlot;
+    size_t pos;
+    uint64_t count;
+    int32_t n = 0;
+
+    if ((pAsync == NULL) || (pComp == NULL))
+    {
+        return 0;
+    }
+    /* clear the descriptor before draining, a completion posted meanwhile
+       signals it again */
+    (void)read(pAsync->compFd, &count, sizeof(count));
+
+    while (n < max)
+    {
+        pSlot = HbiAsyncRingTake(&pAsync->cq, &pos);
+        if (pSlot == NULL)
+        {
+            break;
+        }
+        pComp[n++] = pSlot->u.comp;
+        HbiAsyncRingRelease(&pAsync->cq, pSlot, pos);
+        atomic_fetch_sub(&pAsync->inflight, 1);
+    }
+
+    /* more left than fit in pComp, keep the descriptor readable */
+    if ((n == max) && (atomic_load(&pAsync->cq.head) != atomic_load(&pAsync->cq.tail)))
+    {
+        HbiAsyncSignal(pAsync->compFd);
+    }
+    return n;
+}
@@ -0,0 +1,196 @@
+/*******************************************************************************
+* Copyright (C) 2021 Microchip Technology Inc. and its subsidiaries.
+*
+* Subject to your compliance with these terms, you may use Microchip software
+* and any derivatives exclusively with Microchip products. It is your
+* responsibility to comply with third party license terms applicable to your
+* use of third party software (including open source software) that may
+* accompany Microchip software.
+*
+* THIS SOFTWARE IS SUPPLIED BY MICROCHIP "AS IS". NO WARRANTIES, WHETHER
+* EXPRESS, IMPLIED OR STATUTORY, APPLY TO THIS SOFTWARE, INCLUDING ANY IMPLIED
+* WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY, AND FITNESS FOR A
+* PARTICULAR PURPOSE.
+*
+* IN NO EVENT WILL MICROCHIP BE LIABLE FOR ANY INDIRECT, SPECIAL, PUNITIVE,
+* INCIDENTAL OR CONSEQUENTIAL LOSS, DAMAGE, COST OR EXPENSE OF ANY KIND
+* WHATSOEVER RELATED TO THE SOFTWARE, HOWEVER CAUSED, EVEN IF MICROCHIP HAS
+* BEEN ADVISED OF THE POSSIBILITY OR THE DAMAGES ARE FORESEEABLE. TO THE
+* FULLEST EXTENT ALLOWED BY LAW, MICROCHIP'S TOTAL LIABILITY ON ALL CLAIMS IN
+* ANY WAY RELATED TO THIS SOFTWARE WILL NOT EXCEED THE AMOUNT OF FEES, IF ANY,
+* THAT YOU HAVE PAID DIRECTLY TO MICROCHIP FOR THIS SOFTWARE.
+*******************************************************************************/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include "hbi_port.h"
+
+/* Transfer buffer pool of one device. A single cache line aligned block
+ * holds the core frame buffer followed by numBufs buffers of bufSize
+ * bytes, each rounded up to whole cache lines, and HBI_BATCH_POOL slots of
+ * batch storage. Free buffers and slots are tracked in bit masks updated
+ * with compare and swap, so taking and returning one never blocks on the
+ * bus lock and never calls the allocator.
+ */
+
+#define HBI_BUF_ROUND(n)  (((n) + HBI_CACHE_LINE - 1) & ~(size_t)(HBI_CACHE_LINE - 1))
+#define HBI_BUF_ALL(n)    (((n) >= 32) ? 0xFFFFFFFFu : ((1u << (n)) - 1))
+
+/* distance between two pool buffers */
+static size_t HbiBufStride(HbiDevice *pDev)
+{
+    return HBI_BUF_ROUND(pDev->bufSize);
+}
+
+/* first pool buffer, the core frame buffer comes before it */
+static uint8_t *HbiBufBase(HbiDevice *pDev)
+{
+    return pDev->pBufPool + HBI_BUF_ROUND(HBI_XFER_BUF_BYTES);
+}
+
+/* clear the lowest bit set in *pFree, returns its number or -1 if none is */
+static int32_t HbiBufTake(_Atomic uint32_t *pFree)
+{
+    uint32_t mask, n;
+
+    mask = atomic_load(pFree);
+    do
+    {
+        if (mask == 0)
+        {
+            return -1;
+        }
+        n = __builtin_ctz(mask);
+    } while (!atomic_compare_exchange_weak(pFree, &mask, mask & ~(1u << n)));
+
+    return (int32_t)n;
+}
+
+/* allocate the pool when the device is opened, after the transport has set
+   maxMsg to what the bus can carry in one transfer */
+bool HbiBufPoolInit(HbiDevice *pDev, HbiDeviceCfg const *pCfg)
+{
+    void *pPool;
+
+    if (pCfg && pCfg->bufSize)
+    {
+        pDev->bufSize = pCfg->bufSize;
+    }
+    else
+    {
+        pDev->bufSize = pDev->maxMsg ? pDev->maxMsg : HBI_SPIDEV_BUFSIZ;
+    }
+    pDev->numBufs = (pCfg && pCfg->numBufs) ? pCfg->numBufs : HBI_BUF_POOL_DEFAULT;
+    if (pDev->numBufs > HBI_BUF_POOL_MAX)
+    {
+        pDev->numBufs = HBI_BUF_POOL_MAX;
+    }
+
+    /* a batch slot holds the batch buffer, then the frames, both sized to
+       the bus limit */
+    pDev->batchFrameOffset = HBI_BUF_ROUND(HbiBatchMaxBytes(pDev));
+    pDev->batchStride = pDev->batchFrameOffset +
+        HBI_BUF_ROUND(HbiBatchMaxFrames(pDev) * sizeof(HbiBatchFrame));
+
+    if (posix_memalign(&pPool, HBI_CACHE_LINE,
+        HBI_BUF_ROUND(HBI_XFER_BUF_BYTES) + pDev->numBufs * HbiBufStride(pDev) +
+        HBI_BATCH_POOL * pDev->batchStride) != 0)
+    {
+        return false;
+    }
+    pDev->pBufPool = pPool;
+    pDev->xferBuf = pPool;
+    pDev->pBatchPool = HbiBufBase(pDev) + pDev->numBufs * HbiBufStride(pDev);
+    atomic_init(&pDev->bufFree, HBI_BUF_ALL(pDev->numBufs));
+    atomic_init(&pDev->batchFree, HBI_BUF_ALL(HBI_BATCH_POOL));
+    return true;
+}
+
+void HbiBufPoolFree(HbiDevice *pDev)
+{
+    if ((atomic_load(&pDev->bufFree) != HBI_BUF_ALL(pDev->numBufs)) ||
+        (atomic_load(&pDev->batchFree) != HBI_BUF_ALL(HBI_BATCH_POOL)))
+    {
+        printf("transfer buffers still in use at close\n");
+    }
+    free(pDev->pBufPool);
+    pDev->pBufPool = NULL;
+    pDev->xferBuf = NULL;
+    pDev->pBatchPool = NULL;
+}
+
+/* take a batch storage slot of batchStride bytes, NULL if all are in use */
+void *HbiBufBatchGet(HbiDevice *pDev)
+{
+    int32_t n = HbiBufTake(&pDev->batchFree);
+
+    return (n < 0) ? NULL : pDev->pBatchPool + n * pDev->batchStride;
+}
+
+/* give back a slot taken by HbiBufBatchGet(), false if pMem is not one */
+bool HbiBufBatchPut(HbiDevice *pDev, void *pMem)
+{
+    size_t offset = (uint8_t *)pMem - pDev->pBatchPool;
+
+    if (((uint8_t *)pMem < pDev->pBatchPool) || (offset % pDev->batchStride) ||
+        (offset / pDev->batchStride >= HBI_BATCH_POOL))
+    {
+        return false;
+    }
+    atomic_fetch_or(&pDev->batchFree, 1u << (offset / pDev->batchStride));
+    return true;
+}
+
+/*********************************************************************************/
+/*  Description: take a transfer buffer of at least size bytes from the pool of */
+/*  pDev. The buffer is cache line aligned and stays owned by the caller until  */
+/*  given back with HbiBufPut(). Returns NULL if size is larger than             */
+/*  HbiBufSize() or all buffers are in use, the pool never grows.               */
+/*********************************************************************************/
+void *HbiBufGet(HbiDevice *pDev, size_t size)
+{
+    int32_t n;
+
+    if ((pDev == NULL) || (size > pDev->bufSize))
+    {
+        return NULL;
+    }
+    n = HbiBufTake(&pDev->bufFree);
+    if (n < 0)
+    {
+        return NULL;
+    }
+    return HbiBufBase(pDev) + n * HbiBufStride(pDev);
+}
+
+/*********************************************************************************/
+/*  Description: give a buffer taken by HbiBufGet() back to the pool            */
+/*********************************************************************************/
+void HbiBufPut(HbiDevice *pDev, void *pBuf)
+{
+    size_t offset;
+
+    if ((pDev == NULL) || (pBuf == NULL))
+    {
+        return;
+    }
+    offset = (uint8_t *)pBuf - HbiBufBase(pDev);
+    if (((uint8_t *)pBuf < HbiBufBase(pDev)) || (offset % HbiBufStride(pDev)) ||
+        (offset / HbiBufStride(pDev) >= pDev->numBufs))
+    {
+        printf("HbiBufPut: %p is not a pool buffer\n", pBuf);
+        return;
+    }
+    atomic_fetch_or(&pDev->bufFree, 1u << (offset / HbiBufStride(pDev)));
+}
+
+/*********************************************************************************/
+/*  Description: size of the buffers handed out by HbiBufGet()                  */
+/*********************************************************************************/
+size_t HbiBufSize(HbiDevice *pDev)
+{
+    return pDev ? pDev->bufSize : 0;
+}
@@ -0,0 +1,220 @@
+/*******************************************************************************
+* Copyright (C) 2021 Microchip Technology Inc. and its subsidiaries.
+*
+* Subject to your compliance with these terms, you may use Microchip software
+* and any derivatives exclusively with Microchip products. It is your
+* responsibility to comply with third party license terms applicable to your
+* use of third party software (including open source software) that may
+* accompany Microchip software.
+*
+* THIS SOFTWARE IS SUPPLIED BY MICROCHIP "AS IS". NO WARRANTIES, WHETHER
+* EXPRESS, IMPLIED OR STATUTORY, APPLY TO THIS SOFTWARE, INCLUDING ANY IMPLIED
+* WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY, AND FITNESS FOR A
+* PARTICULAR PURPOSE.
+*
+* IN NO EVENT WILL MICROCHIP BE LIABLE FOR ANY INDIRECT, SPECIAL, PUNITIVE,
+* INCIDENTAL OR CONSEQUENTIAL LOSS, DAMAGE, COST OR EXPENSE OF ANY KIND
+* WHATSOEVER RELATED TO THE SOFTWARE, HOWEVER CAUSED, EVEN IF MICROCHIP HAS
+* BEEN ADVISED OF THE POSSIBILITY OR THE DAMAGES ARE FORESEEABLE. TO THE
+* FULLEST EXTENT ALLOWED BY LAW, MICROCHIP'S TOTAL LIABILITY ON ALL CLAIMS IN
+* ANY WAY RELATED TO THIS SOFTWARE WILL NOT EXCEED THE AMOUNT OF FEES, IF ANY,
+* THAT YOU HAVE PAID DIRECTLY TO MICROCHIP FOR THIS SOFTWARE.
+*******************************************************************************/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hbi_port.h"
+
+/* Register shadow of one device. Every 16-bit register of pages 0 to 254
+ * has a shadow word, a valid bit and a volatile bit. Volatile registers
+ * are changed by the device itself and always read from the bus, all other
+ * registers only change when the host writes them, so once read or written
+ * they are served from the shadow. Page 255 is a window into device memory
+ * and never cached.
+ */
+
+#define HBI_CACHE_WORDS              (0xFF00 >> 1)
+#define HBI_CACHE_MAP_WORDS          (HBI_CACHE_WORDS / 32)
+#define HBI_CACHE_DEFAULT_READ_AHEAD 32
+
+struct HbiRegCache
+{
+    uint32_t readAhead;                         /* bytes read on a miss */
+    uint32_t valid[HBI_CACHE_MAP_WORDS];
+    uint32_t volatileMap[HBI_CACHE_MAP_WORDS];
+    uint16_t shadow[HBI_CACHE_WORDS];           /* host format */
+};
+
+/* registers updated by the device: event and status registers, software
+   flags, reset, firmware count and state, host command and its result */
+static const HbiRegRange hbiDefaultVolatile[] =
+{
+    { 0x0000, 0x0007 },
+    { 0x0014, 0x0015 },
+    { 0x0026, 0x0029 },
+    { 0x0032, 0x0035 },
+};
+
+#define HBI_CACHE_BIT(map, word)  ((map)[(word) >> 5] & (1u << ((word) & 31)))
+#define HBI_CACHE_SET(map, word)  ((map)[(word) >> 5] |= (1u << ((word) & 31)))
+#define HBI_CACHE_CLR(map, word)  ((map)[(word) >> 5] &= ~(1u << ((word) & 31)))
+
+/* true if [reg, reg + size) lies in the cacheable register pages */
+static bool HbiCacheInRange(uint16_t reg, size_t size)
+{
+    return (size != 0) && !(reg & 1) && !(size & 1) && (((uint32_t)reg + size) <= 0xFF00);
+}
+
+/*********************************************************************************/
+/*  Description: serve a read from the shadow. Succeeds only if every word is    */
+/*  valid and none is volatile, buf receives the data in host format.            */
+/*********************************************************************************/
+bool HbiCacheLookup(HbiRegCache *pCache, uint16_t reg, uint8_t *buf, size_t size)
+{
+    uint32_t word = reg >> 1;
+    uint32_t end = word + (size >> 1);
+    uint32_t i;
+
+    if ((pCache == NULL) || !HbiCacheInRange(reg, size))
+    {
+        return false;
+    }
+    for (i = word; i < end; i++)
+    {
+        if (!HBI_CACHE_BIT(pCache->valid, i) || HBI_CACHE_BIT(pCache->volatileMap, i))
+        {
+            return false;
+        }
+    }
+    memcpy(buf, &pCache->shadow[word], size);
+    return true;
+}
+
+/*********************************************************************************/
+/*  Description: number of bytes to read from reg to satisfy a read of size      */
+/*  bytes. A miss on non-volatile registers is extended to the configured read   */
+/*  ahead, stopping at the first volatile register and at the end of the page.   */
+/*********************************************************************************/
+size_t HbiCacheReadAhead(HbiRegCache *pCache, uint16_t reg, size_t size)
+{
+    uint32_t word = reg >> 1;
+    size_t n;
+
+    if ((pCache == NULL) || (pCache->readAhead <= size) || !HbiCacheInRange(reg, size))
+    {
+        return size;
+    }
+    for (n = 0; n < size; n += 2)
+    {
+        if (HBI_CACHE_BIT(pCache->volatileMap, word + (n >> 1)))
+        {
+            return size;
+        }
+    }
+    while ((n < pCache->readAhead) && (((reg & 0xFF) + n) < 0x100) &&
+        !HBI_CACHE_BIT(pCache->volatileMap, word + (n >> 1)))
+    {
+        n += 2;
+    }
+    return n;
+}
+
+/*********************************************************************************/
+/*  Description: record size bytes read from or written to the device at reg.   */
+/*  data is in device format if devFormat is set, host format otherwise.         */
+/*  Volatile registers and page 255 are skipped.                                 */
+/*********************************************************************************/
+void HbiCacheFill(HbiRegCache *pCache, uint16_t reg, uint8_t const *data, size_t size,
+    bool devFormat)
+{
+    uint16_t const *dataPtr = (uint16_t const *)data;
+    uint32_t word = reg >> 1;
+    uint32_t i;
+
+    if ((pCache == NULL) || !HbiCacheInRange(reg, size))
+    {
+        return;
+    }
+    for (i = 0; i < (size >> 1); i++, word++)
+    {
+        if (HBI_CACHE_BIT(pCache->volatileMap, word))
+        {
+            continue;
+        }
+        pCache->shadow[word] = devFormat ? HBI_VAL(HBI_DEV_ENDIAN_BIG, dataPtr[i]) : dataPtr[i];
+        HBI_CACHE_SET(pCache->valid, word);
+    }
+}
+
+/* forget every shadowed value */
+void HbiCacheInvalidate(HbiRegCache *pCache)
+{
+    if (pCache)
+    {
+        memset(pCache->valid, 0, sizeof(pCache->valid));
+    }
+}
+
+/*********************************************************************************/
+/*  Description: start shadowing the registers of pDev. pCfg NULL, or a NULL     */
+/*  volatile table in it, selects the driver defaults. Enabling again replaces   */
+/*  the configuration and empties the shadow.                                    */
+/*********************************************************************************/
+HbiStatus HbiCacheEnable(HbiDevice *pDev, HbiCacheCfg const *pCfg)
+{
+    HbiRegCache *pCache;
+    HbiRegRange const *pRange = hbiDefaultVolatile;
+    uint32_t numRange = sizeof(hbiDefaultVolatile) / sizeof(hbiDefaultVolatile[0]);
+    uint32_t i, word;
+
+    if (pDev == NULL)
+    {
+        return HBI_STATUS_BAD_HANDLE;
+    }
+    if (pCfg && pCfg->pVolatile)
+    {
+        pRange = pCfg->pVolatile;
+        numRange = pCfg->numVolatile;
+    }
+    pCache = calloc(1, sizeof(HbiRegCache));
+    if (pCache == NULL)
+    {
+        return HBI_STATUS_RESOURCE_ERR;
+    }
+    pCache->readAhead = pCfg ? pCfg->readAhead : HBI_CACHE_DEFAULT_READ_AHEAD;
+    if (pCache->readAhead > ZL380xx_MAX_ACCESS_SIZE_IN_BYTES)
+    {
+        pCache->readAhead = ZL380xx_MAX_ACCESS_SIZE_IN_BYTES;
+    }
+    for (i = 0; i < numRange; i++)
+    {
+        for (word = pRange[i].first >> 1; (word <= (uint32_t)(pRange[i].last >> 1)) &&
+            (word < HBI_CACHE_WORDS); word++)
+        {
+            HBI_CACHE_SET(pCache->volatileMap, word);
+        }
+    }
+
+    pthread_mutex_lock(&pDev->busLock);
+    free(pDev->pCache);
+    pDev->pCache = pCache;
+    pthread_mutex_unlock(&pDev->busLock);
+    return HBI_STATUS_SUCCESS;
+}
+
+/*********************************************************************************/
+/*  Description: stop shadowing, all reads go to the device again               */
+/*********************************************************************************/
+void HbiCacheDisable(HbiDevice *pDev)
+{
+    if (pDev == NULL)
+    {
+        return;
+    }
+    pthread_mutex_lock(&pDev->busLock);
+    free(pDev->pCache);
+    pDev->pCache = NULL;
+    pthread_mutex_unlock(&pDev->busLock);
+}
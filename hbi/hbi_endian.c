@@ -0,0 +1,120 @@
+/*******************************************************************************
+* Copyright (C) 2021 Microchip Technology Inc. and its subsidiaries.
+*
+* Subject to your compliance with these terms, you may use Microchip software
+* and any derivatives exclusively with Microchip products. It is your
+* responsibility to comply with third party license terms applicable to your
+* use of third party software (including open source software) that may
+* accompany Microchip software.
+*
+* THIS SOFTWARE IS SUPPLIED BY MICROCHIP "AS IS". NO WARRANTIES, WHETHER
+* EXPRESS, IMPLIED OR STATUTORY, APPLY TO THIS SOFTWARE, INCLUDING ANY IMPLIED
+* WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY, AND FITNESS FOR A
+* PARTICULAR PURPOSE.
+*
+* IN NO EVENT WILL MICROCHIP BE LIABLE FOR ANY INDIRECT, SPECIAL, PUNITIVE,
+* INCIDENTAL OR CONSEQUENTIAL LOSS, DAMAGE, COST OR EXPENSE OF ANY KIND
+* WHATSOEVER RELATED TO THE SOFTWARE, HOWEVER CAUSED, EVEN IF MICROCHIP HAS
+* BEEN ADVISED OF THE POSSIBILITY OR THE DAMAGES ARE FORESEEABLE. TO THE
+* FULLEST EXTENT ALLOWED BY LAW, MICROCHIP'S TOTAL LIABILITY ON ALL CLAIMS IN
+* ANY WAY RELATED TO THIS SOFTWARE WILL NOT EXCEED THE AMOUNT OF FEES, IF ANY,
+* THAT YOU HAVE PAID DIRECTLY TO MICROCHIP FOR THIS SOFTWARE.
+*******************************************************************************/
+
+#include <stdint.h>
+#include <string.h>
+#include "hbi.h"
+
+/* Word order conversion between host and device. The device is big endian,
+ * on a little endian host every 16-bit word has its bytes swapped. The
+ * vector unit is picked at compile time: AVX2 if the build enables it
+ * (e.g. -mavx2 or -march=native), else SSE2 on x86, NEON on ARM, else a
+ * scalar loop working on 64 bits at a time.
+ */
+
+#if !MATCH_ENDIAN(HBI_DEV_ENDIAN_BIG)
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define HBI_SWAP_VECTOR_BYTES        32
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define HBI_SWAP_VECTOR_BYTES        16
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define HBI_SWAP_VECTOR_BYTES        16
+#else
+#define HBI_SWAP_VECTOR_BYTES        8
+#endif
+
+/* swap bytes of n bytes of words, n a multiple of HBI_SWAP_VECTOR_BYTES */
+static void HbiSwapVector(uint8_t *dst, uint8_t const *src, size_t n)
+{
+    size_t i;
+#if defined(__AVX2__)
+    const __m256i shuf = _mm256_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14,
+        1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+    __m256i v;
+
+    for (i = 0; i < n; i += 32)
+    {
+        v = _mm256_loadu_si256((__m256i const *)&src[i]);
+        _mm256_storeu_si256((__m256i *)&dst[i], _mm256_shuffle_epi8(v, shuf));
+    }
+#elif defined(__SSE2__)
+    __m128i v;
+
+    for (i = 0; i < n; i += 16)
+    {
+        v = _mm_loadu_si128((__m128i const *)&src[i]);
+        v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+        _mm_storeu_si128((__m128i *)&dst[i], v);
+    }
+#elif defined(__ARM_NEON)
+    for (i = 0; i < n; i += 16)
+    {
+        vst1q_u8(&dst[i], vrev16q_u8(vld1q_u8(&src[i])));
+    }
+#else
+    uint64_t v;
+
+    for (i = 0; i < n; i += 8)
+    {
+        memcpy(&v, &src[i], sizeof(v));
+        v = ((v & 0x00FF00FF00FF00FFull) << 8) | ((v >> 8) & 0x00FF00FF00FF00FFull);
+        memcpy(&dst[i], &v, sizeof(v));
+    }
+#endif
+}
+
+#endif /* !MATCH_ENDIAN(HBI_DEV_ENDIAN_BIG) */
+
+/*********************************************************************************/
+/*  Description: convert words words from host to device order or back, the     */
+/*  operation is the same both ways. dst may be src for an in place conversion, */
+/*  neither needs to be aligned. Compiles to a plain copy on big endian hosts.   */
+/*********************************************************************************/
+void HbiConvertWords(void *dst, void const *src, size_t words)
+{
+#if MATCH_ENDIAN(HBI_DEV_ENDIAN_BIG)
+    if (dst != src)
+    {
+        memmove(dst, src, words << 1);
+    }
+#else
+    uint8_t *dstPtr = dst;
+    uint8_t const *srcPtr = src;
+    size_t n = words << 1;
+    size_t bulk = n & ~(size_t)(HBI_SWAP_VECTOR_BYTES - 1);
+    size_t i;
+    uint8_t temp;
+
+    HbiSwapVector(dstPtr, srcPtr, bulk);
+    for (i = bulk; i < n; i += 2)
+    {
+        temp = srcPtr[i];
+        dstPtr[i] = srcPtr[i + 1];
+        dstPtr[i + 1] = temp;
+    }
+#endif
+}
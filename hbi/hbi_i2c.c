@@ -0,0 +1,256 @@
+/*******************************************************************************
+* Copyright (C) 2021 Microchip Technology Inc. and its subsidiaries.
+*
+* Subject to your compliance with these terms, you may use Microchip software
+* and any derivatives exclusively with Microchip products. It is your
+* responsibility to comply with third party license terms applicable to your
+* use of third party software (including open source software) that may
+* accompany Microchip software.
+*
+* THIS SOFTWARE IS SUPPLIED BY MICROCHIP "AS IS". NO WARRANTIES, WHETHER
+* EXPRESS, IMPLIED OR STATUTORY, APPLY TO THIS SOFTWARE, INCLUDING ANY IMPLIED
+* WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY, AND FITNESS FOR A
+* PARTICULAR PURPOSE.
+*
+* IN NO EVENT WILL MICROCHIP BE LIABLE FOR ANY INDIRECT, SPECIAL, PUNITIVE,
+* INCIDENTAL OR CONSEQUENTIAL LOSS, DAMAGE, COST OR EXPENSE OF ANY KIND
+* WHATSOEVER RELATED TO THE SOFTWARE, HOWEVER CAUSED, EVEN IF MICROCHIP HAS
+* BEEN ADVISED OF THE POSSIBILITY OR THE DAMAGES ARE FORESEEABLE. TO THE
+* FULLEST EXTENT ALLOWED BY LAW, MICROCHIP'S TOTAL LIABILITY ON ALL CLAIMS IN
+* ANY WAY RELATED TO THIS SOFTWARE WILL NOT EXCEED THE AMOUNT OF FEES, IF ANY,
+* THAT YOU HAVE PAID DIRECTLY TO MICROCHIP FOR THIS SOFTWARE.
+*******************************************************************************/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/ioctl.h>
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+#include "hbi_port.h"
+
+/* i2c-dev refuses messages longer than this */
+#define HBI_I2C_MSG_MAX              8192
+
+/* Messages of one I2C_RDWR call. A frame longer than the adapter takes in
+ * one message is sent as a first message followed by I2C_M_NOSTART
+ * continuations, which the adapter puts on the bus without a new start
+ * condition and address, so the device still sees a single frame. All
+ * pieces of a frame always go into the same call.
+ */
+typedef struct
+{
+    unsigned long funcs;   /* I2C_FUNCS of the adapter */
+    uint32_t n;            /* messages queued */
+    struct i2c_msg msg[I2C_RDRW_IOCTL_MAX_MSGS];
+}HbiI2c;
+
+/* number of messages needed for len bytes, 0 if they can't be sent */
+static uint32_t HbiI2cMsgCount(HbiDevice *pDev, size_t len)
+{
+    HbiI2c *pI2c = pDev->pPriv;
+    uint32_t n;
+
+    if (len == 0)
+    {
+        return 0;
+    }
+    n = (len + pDev->maxMsg - 1) / pDev->maxMsg;
+    if ((n > 1) && !(pI2c->funcs & I2C_FUNC_NOSTART))
+    {
+        return 0;
+    }
+    return n;
+}
+
+/* queue len bytes as one message or a chain of continuations, the caller
+   checked there is room with HbiI2cMsgCount() */
+static void HbiI2cQueue(HbiDevice *pDev, uint16_t flags, uint8_t *buf, size_t len)
+{
+    HbiI2c *pI2c = pDev->pPriv;
+    struct i2c_msg *pMsg;
+    size_t piece;
+
+    while (len)
+    {
+        piece = (len > pDev->maxMsg) ? pDev->maxMsg : len;
+        pMsg = &pI2c->msg[pI2c->n++];
+        pMsg->addr = pDev->i2cAddr;
+        pMsg->flags = flags;
+        pMsg->len = piece;
+        pMsg->buf = buf;
+        flags |= I2C_M_NOSTART;
+        buf += piece;
+        len -= piece;
+    }
+}
+
+/* send the queued messages in one I2C_RDWR call */
+static bool HbiI2cFlush(HbiDevice *pDev, const char *what)
+{
+    HbiI2c *pI2c = pDev->pPriv;
+    struct i2c_rdwr_ioctl_data msgset;
+    int32_t ret;
+
+    if (pI2c->n == 0)
+    {
+        return true;
+    }
+    msgset.msgs = pI2c->msg;
+    msgset.nmsgs = pI2c->n;
+    pI2c->n = 0;
+    ret = ioctl(pDev->fd, I2C_RDWR, &msgset);
+    if (ret < 0)
+    {
+        printf("ioctl(I2C_RDWR) in %s: %s\n", what, strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+/* queue a frame of ntx bytes to send and nrx to read back, flushing first
+   if it does not fit in the current call */
+static bool HbiI2cQueueFrame(HbiDevice *pDev, uint8_t const *tx, size_t ntx, uint8_t *rx,
+    size_t nrx, const char *what)
+{
+    HbiI2c *pI2c = pDev->pPriv;
+    uint32_t ntxMsgs = HbiI2cMsgCount(pDev, ntx);
+    uint32_t nrxMsgs = HbiI2cMsgCount(pDev, nrx);
+
+    if (((ntx != 0) && (ntxMsgs == 0)) || ((nrx != 0) && (nrxMsgs == 0)) ||
+        ((ntxMsgs + nrxMsgs) > I2C_RDRW_IOCTL_MAX_MSGS))
+    {
+        printf("%s: frame of %u bytes exceeds the %u byte adapter message limit\n",
+            what, (uint32_t)(ntx + nrx), pDev->maxMsg);
+        return false;
+    }
+    if (((pI2c->n + ntxMsgs + nrxMsgs) > I2C_RDRW_IOCTL_MAX_MSGS) && !HbiI2cFlush(pDev, what))
+    {
+        return false;
+    }
+    /* i2c_msg has no const buffer, written messages are only read */
+    HbiI2cQueue(pDev, 0, (uint8_t *)tx, ntx);
+    HbiI2cQueue(pDev, I2C_M_RD, rx, nrx);
+    return true;
+}
+
+/********************************************************************/
+/* 	Open I2C device				 		                            */
+/* This example implementation is for user-mode linux. This 	    */
+/* code should be ported to the client's specific HW host mcu/mpu   */
+/********************************************************************/
+static bool HbiI2cOpen(HbiDevice *pDev)
+{
+
+    int32_t ret_val;
+    int32_t handle;
+    HbiI2c *pI2c;
+
+    /* Open the device node for the I2C bus */
+    handle = open(pDev->path, O_RDWR);
+    if (handle < 0)
+    {
+        printf("can't open device %s", pDev->path);
+        return false;
+    }
+    /* Set I2C_SLAVE */
+    ret_val = ioctl(handle, I2C_SLAVE, pDev->i2cAddr);
+    if (ret_val < 0)
+    {
+        printf("Could not set I2C_SLAVE.");
+        close(handle);
+        return false;
+    }
+    pI2c = calloc(1, sizeof(HbiI2c));
+    if (pI2c == NULL)
+    {
+        close(handle);
+        return false;
+    }
+    /* without the functionality mask assume a plain adapter, frames
+       longer than one message are then refused */
+    if (ioctl(handle, I2C_FUNCS, &pI2c->funcs) < 0)
+    {
+        pI2c->funcs = 0;
+    }
+    if ((pDev->maxMsg == 0) || (pDev->maxMsg > HBI_I2C_MSG_MAX))
+    {
+        pDev->maxMsg = HBI_I2C_MSG_MAX;
+    }
+    pDev->pPriv = pI2c;
+    pDev->fd = handle;
+    return true;
+}
+
+static void HbiI2cClose(HbiDevice *pDev)
+{
+    close(pDev->fd);
+    free(pDev->pPriv);
+    pDev->pPriv = NULL;
+}
+
+/*********************************************************************************/
+/* 					Read from Device.							                 */
+/* This example implementation is for user-mode linux. This 	                 */
+/* code should be ported to the client's specific HW host mcu/mpu                */
+/*********************************************************************************/
+static bool HbiI2cRead(HbiDevice *pDev, void *pSrc, void *pDst, size_t nread, size_t nwrite)
+{
+    /* header and read back with a repeated start, in one call */
+    return HbiI2cQueueFrame(pDev, pSrc, nwrite, pDst, nread, "i2c_read") &&
+        HbiI2cFlush(pDev, "i2c_read");
+}
+/*********************************************************************************/
+/* 					Write to Device.							                 */
+/* This example implementation is for user-mode linux. This 	                 */
+/* code should be ported to the client's specific HW host mcu/mpu                */
+/*********************************************************************************/
+static bool HbiI2cWrite(HbiDevice *pDev, uint8_t const *tx, uint8_t const *rx, size_t len)
+{
+    (void)rx;
+    return HbiI2cQueueFrame(pDev, tx, len, NULL, 0, "i2c_write") &&
+        HbiI2cFlush(pDev, "i2c_write");
+}
+/*********************************************************************************/
+/* 					Send a batch of HBI frames to Device.		                 */
+/* This example implementation is for user-mode linux. This 	                 */
+/* code should be ported to the client's specific HW host mcu/mpu                */
+/*********************************************************************************/
+static bool HbiI2cBatch(HbiDevice *pDev, HbiBatch *pBatch)
+{
+    HbiBatchFrame *pFrame;
+    int32_t i;
+
+    /* as many frames per call as the adapter takes messages, a frame is
+       never split across two calls */
+    for (i = 0; i < pBatch->numFrames; i++)
+    {
+        pFrame = &pBatch->frame[i];
+        if (!HbiI2cQueueFrame(pDev, pFrame->tx, pFrame->txLen,
+            pFrame->rx, pFrame->rxLen, "i2c_batch"))
+        {
+            ((HbiI2c *)pDev->pPriv)->n = 0;
+            return false;
+        }
+    }
+    return HbiI2cFlush(pDev, "i2c_batch");
+}
+
+/* an i2c message can not be gathered from two buffers without I2C_M_NOSTART
+   support from the adapter, frames are assembled by the core instead */
+const HbiTransport hbiI2cTransport =
+{
+    "i2c",
+    HbiI2cOpen,
+    HbiI2cClose,
+    HbiI2cRead,
+    HbiI2cWrite,
+    NULL,
+    HbiI2cBatch,
+    NULL,
+    NULL
+};
@@ -0,0 +1,127 @@
+/*
+* hbi_port.h  --  Driver internal definitions shared with HBI transports
+*
+*/
+/*******************************************************************************
+* Copyright (C) 2021 Microchip Technology Inc. and its subsidiaries.
+*
+* Subject to your compliance with these terms, you may use Microchip software
+* and any derivatives exclusively with Microchip products. It is your
+* responsibility to comply with third party license terms applicable to your
+* use of third party software (including open source software) that may
+* accompany Microchip software.
+*
+* THIS SOFTWARE IS SUPPLIED BY MICROCHIP "AS IS". NO WARRANTIES, WHETHER
+* EXPRESS, IMPLIED OR STATUTORY, APPLY TO THIS SOFTWARE, INCLUDING ANY IMPLIED
+* WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY, AND FITNESS FOR A
+* PARTICULAR PURPOSE.
+*
+* IN NO EVENT WILL MICROCHIP BE LIABLE FOR ANY INDIRECT, SPECIAL, PUNITIVE,
+* INCIDENTAL OR CONSEQUENTIAL LOSS, DAMAGE, COST OR EXPENSE OF ANY KIND
+* WHATSOEVER RELATED TO THE SOFTWARE, HOWEVER CAUSED, EVEN IF MICROCHIP HAS
+* BEEN ADVISED OF THE POSSIBILITY OR THE DAMAGES ARE FORESEEABLE. TO THE
+* FULLEST EXTENT ALLOWED BY LAW, MICROCHIP'S TOTAL LIABILITY ON ALL CLAIMS IN
+* ANY WAY RELATED TO THIS SOFTWARE WILL NOT EXCEED THE AMOUNT OF FEES, IF ANY,
+* THAT YOU HAVE PAID DIRECTLY TO MICROCHIP FOR THIS SOFTWARE.
+*******************************************************************************/
+
+
+#ifndef __HBI_PORT_H__
+#define __HBI_PORT_H__
+#include <pthread.h>
+#include "hbi.h"
+
+#define ZL380xx_MAX_ACCESS_SIZE_IN_BYTES       256 /*128 16-bit words*/
+#define HBI_PATH_MAX                           64
+
+typedef struct HbiRegCache HbiRegCache;
+typedef struct HbiTrace HbiTrace;
+typedef struct HbiCapture HbiCapture;
+
+/* driver state kept for every device opened with HbiPortOpen(). Transports
+ * use the bus fields, the rest belongs to the driver core.
+ */
+struct HbiDevice
+{
+    HbiTransport const *pTransport;
+    char     path[HBI_PATH_MAX]; /* bus device node */
+    int32_t  fd;
+    void    *pPriv;  /* transport private data */
+    uint32_t mode;   /* SPI mode */
+    uint8_t  bits;   /* SPI bits per word */
+    uint32_t speed;  /* SPI clock in Hz */
+    uint32_t bulkSpeed; /* SPI clock of bulk transfers, 0 to use speed */
+    uint16_t i2cAddr;
+    uint32_t maxMsg; /* largest bus message in bytes, set by open, 0 for no limit */
+    uint32_t msgAlign; /* transfers count against maxMsg rounded up to this, 0 for their length */
+    uint8_t  page;   /* page currently selected on the device, 0 if unknown */
+    HbiEventSource *pEvent; /* host command completion interrupt, NULL to poll */
+    HbiRegCache *pCache;    /* register shadow, NULL if disabled */
+    HbiStats stats;         /* performance counters, updated under busLock */
+    HbiTrace *pTrace;       /* frame trace ring, NULL if disabled */
+    HbiCapture *pCapture;   /* full frame capture file, NULL if disabled */
+    /* locks, always taken in this order. busLock covers a single bus access
+       and the cached state it depends on, cmdLock a whole host command or a
+       transaction started by HbiTransactionBegin(). Both are recursive */
+    pthread_mutex_t cmdLock;
+    pthread_mutex_t busLock;
+    /* transfer buffer pool, see hbi_buf.c. xferBuf is the core's own
+       frame buffer, used under busLock to build a frame header and its
+       payload in device format, so the caller's buffer is never modified */
+    uint8_t *pBufPool;
+    uint32_t bufSize;  /* size of a pool buffer, maxMsg unless configured */
+    uint32_t numBufs;
+    _Atomic uint32_t bufFree; /* bit n set if pool buffer n is free */
+    uint8_t *xferBuf;  /* HBI_XFER_BUF_BYTES */
+    /* HBI_BATCH_POOL batch storage slots follow the pool buffers, each the
+       batch buffer followed by its frames */
+    uint8_t *pBatchPool;
+    size_t   batchStride;  /* size of a slot */
+    size_t   batchFrameOffset; /* offset of the frames in a slot */
+    _Atomic uint32_t batchFree; /* bit n set if slot n is free */
+};
+
+#define HBI_XFER_BUF_BYTES  (4 + ZL380xx_MAX_ACCESS_SIZE_IN_BYTES)
+
+/* clock of a frame of len bytes, see HBI_BULK_MIN_BYTES */
+uint32_t HbiXferSpeed(HbiDevice *pDev, size_t len);
+
+size_t HbiMsgLen(HbiDevice *pDev, size_t len);
+
+/* register shadow, see hbi_cache.c. Called with the bus lock held */
+bool HbiCacheLookup(HbiRegCache *pCache, uint16_t reg, uint8_t *buf, size_t size);
+
+size_t HbiCacheReadAhead(HbiRegCache *pCache, uint16_t reg, size_t size);
+
+void HbiCacheFill(HbiRegCache *pCache, uint16_t reg, uint8_t const *data, size_t size,
+    bool devFormat);
+
+void HbiCacheInvalidate(HbiRegCache *pCache);
+
+/* transfer buffer pool, see hbi_buf.c */
+bool HbiBufPoolInit(HbiDevice *pDev, HbiDeviceCfg const *pCfg);
+
+void HbiBufPoolFree(HbiDevice *pDev);
+
+void *HbiBufBatchGet(HbiDevice *pDev);
+
+bool HbiBufBatchPut(HbiDevice *pDev, void *pMem);
+
+/* performance counters, see hbi_stats.c */
+uint64_t HbiStatsNowNs(void);
+
+void HbiStatsRecord(HbiStats *pStats, HbiStatsOp op, uint64_t startNs);
+
+/* frame trace, see hbi_trace.c. Called with the bus lock held */
+void HbiTraceFrame(HbiTrace *pTrace, uint64_t startNs, uint64_t endNs, uint8_t flags,
+    uint8_t const *tx, size_t ntx, uint8_t const *data, size_t ndata,
+    uint8_t const *rx, size_t nrx);
+
+void HbiTraceFree(HbiTrace *pTrace);
+
+void HbiCaptureFrame(HbiCapture *pCapture, bool first, uint64_t startNs, uint64_t endNs,
+    uint8_t flags, uint8_t const *tx, size_t ntx, uint8_t const *data, size_t ndata, size_t nrx);
+
+void HbiCaptureFree(HbiCapture *pCapture);
+
+#endif /* __HBI_PORT_H__ */
@@ -0,0 +1,701 @@
+/*******************************************************************************
+* Copyright (C) 2021 Microchip Technology Inc. and its subsidiaries.
+*
+* Subject to your compliance with these terms, you may use Microchip software
+* and any derivatives exclusively with Microchip products. It is your
+* responsibility to comply with third party license terms applicable to your
+* use of third party software (including open source software) that may
+* accompany Microchip software.
+*
+* THIS SOFTWARE IS SUPPLIED BY MICROCHIP "AS IS". NO WARRANTIES, WHETHER
+* EXPRESS, IMPLIED OR STATUTORY, APPLY TO THIS SOFTWARE, INCLUDING ANY IMPLIED
+* WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY, AND FITNESS FOR A
+* PARTICULAR PURPOSE.
+*
+* IN NO EVENT WILL MICROCHIP BE LIABLE FOR ANY INDIRECT, SPECIAL, PUNITIVE,
+* INCIDENTAL OR CONSEQUENTIAL LOSS, DAMAGE, COST OR EXPENSE OF ANY KIND
+* WHATSOEVER RELATED TO THE SOFTWARE, HOWEVER CAUSED, EVEN IF MICROCHIP HAS
+* BEEN ADVISED OF THE POSSIBILITY OR THE DAMAGES ARE FORESEEABLE. TO THE
+* FULLEST EXTENT ALLOWED BY LAW, MICROCHIP'S TOTAL LIABILITY ON ALL CLAIMS IN
+* ANY WAY RELATED TO THIS SOFTWARE WILL NOT EXCEED THE AMOUNT OF FEES, IF ANY,
+* THAT YOU HAVE PAID DIRECTLY TO MICROCHIP FOR THIS SOFTWARE.
+*******************************************************************************/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include "hbi_port.h"
+
+/* Simulated ZL380xx behind the HBI. The HBI command stream of every frame
+ * is decoded the way the device does it, registers and the memory reached
+ * through page 255 are kept in RAM and the host command mailbox, reset and
+ * ASR segment table behave like a device running its firmware. Nothing of
+ * the DSP itself is modelled.
+ */
+
+/* HBI commands, high byte of the command word */
+#define SIM_CMD_NOOP                 0xFF
+#define SIM_CMD_SELECT_PAGE          0xFE
+#define SIM_CMD_CONFIGURE            0xFD
+#define SIM_CMD_CONT_PAGED_WRITE     0xFB
+#define SIM_CMD_DIRECT               0x80
+#define SIM_CMD_WRITE                0x80 /* low byte */
+
+/* registers with a side effect */
+#define SIM_REG_SW_FLAGS             0x0006
+#define SIM_REG_PAGE255_BASE         0x000C
+#define SIM_REG_RESET                0x0014
+#define SIM_REG_FWR_COUNT            0x0026
+#define SIM_REG_CUR_FWR              0x0028
+#define SIM_REG_HOST_CMD             0x0032
+#define SIM_REG_HOST_CMD_RESULT      0x0034
+#define SIM_REG_ASR_NUM_SEGMENTS     0x013E
+#define SIM_REG_ASR_SEGMENT_TABLE    0x0140 /* size, address pairs of 32 bits */
+#define SIM_REG_ASR_START            0x04B8
+#define SIM_REG_ASR_END              0x04BC
+
+#define SIM_SW_FLAGS_HOST_CMD        0x0001
+#define SIM_SW_FLAGS_APP_CMD         0x0004
+#define SIM_BOOT_ROM_SIGNATURE       0xD3D3
+#define SIM_ERASE_ALL_KEY            0xAA55
+
+/* host commands understood by the simulated boot ROM and firmware */
+#define SIM_HOST_CMD_SAVE_TO_FLASH   0x0004
+#define SIM_HOST_CMD_FWR_GO          0x0008
+#define SIM_HOST_CMD_ERASE_FLASH     0x0009
+#define SIM_HOST_CMD_FLASH_INIT      0x000B
+#define SIM_HOST_CMD_LOAD_CMP        0x000D
+#define SIM_APP_CMD_ASR_DISABLE      0x800D
+#define SIM_APP_CMD_ASR_ENABLE       0x800E
+
+/* memory layout reported by the simulated firmware: one code segment and
+   the ASR segment, the grammar area follows it */
+#define SIM_CODE_SEGMENT_ADDR        0x20000000
+#define SIM_CODE_SEGMENT_SIZE        0x00030000
+#define SIM_ASR_SEGMENT_ADDR         0x20030000
+#define SIM_ASR_SEGMENT_SIZE         0x00008000
+#define SIM_ASR_AREA_START           0x20040000
+#define SIM_ASR_AREA_END             0x20060000
+
+/* page 255 memory is allocated in blocks on first write, reached through a
+   two level table indexed by the upper 20 address bits */
+#define SIM_MEM_BLOCK_BITS           12
+#define SIM_MEM_BLOCK_SIZE           (1 << SIM_MEM_BLOCK_BITS)
+#define SIM_MEM_MID_BITS             8
+#define SIM_MEM_TOP_ENTRIES          (1 << (32 - SIM_MEM_BLOCK_BITS - SIM_MEM_MID_BITS))
+#define SIM_MEM_MID_ENTRIES          (1 << SIM_MEM_MID_BITS)
+
+typedef enum
+{
+    SIM_PENDING_NONE,
+    SIM_PENDING_CMD,
+    SIM_PENDING_RESET
+}SimPending;
+
+typedef struct
+{
+    HbiSimCfg   cfg;
+    HbiSimStats stats;
+    uint8_t     reg[0x10000];    /* register space, big endian words */
+    uint8_t   **mem[SIM_MEM_TOP_ENTRIES];
+    uint8_t     page;            /* page selected by the last page select */
+    bool        curMem;          /* continuous write goes to page 255 memory */
+    uint32_t    curAddr;         /* address a continuous write continues at */
+    bool        appRunning;
+    bool        asrEnabled;
+    SimPending  pending;
+    uint16_t    pendingNotice;   /* sw flag bits cleared on completion */
+    uint64_t    pendingDoneNs;   /* time the pending operation completes */
+    uint64_t    wireEndNs;       /* time the bus becomes idle */
+    uint32_t    batches;         /* batches sent since HbiSimConfigure() */
+}HbiSim;
+
+static uint64_t HbiSimNowNs(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static uint16_t HbiSimGet16(HbiSim *pSim, uint16_t addr)
+{
+    return ((uint16_t)pSim->reg[addr] << 8) | pSim->reg[addr + 1];
+}
+
+static void HbiSimPut16(HbiSim *pSim, uint16_t addr, uint16_t val)
+{
+    pSim->reg[addr] = val >> 8;
+    pSim->reg[addr + 1] = val & 0xFF;
+}
+
+/* 32-bit registers hold the most significant word first */
+static uint32_t HbiSimGet32(HbiSim *pSim, uint16_t addr)
+{
+    return ((uint32_t)HbiSimGet16(pSim, addr) << 16) | HbiSimGet16(pSim, addr + 2);
+}
+
+static void HbiSimPut32(HbiSim *pSim, uint16_t addr, uint32_t val)
+{
+    HbiSimPut16(pSim, addr, val >> 16);
+    HbiSimPut16(pSim, addr + 2, val & 0xFFFF);
+}
+
+/* memory block holding addr, allocated if alloc is set, NULL if not present */
+static uint8_t *HbiSimMemBlock(HbiSim *pSim, uint32_t addr, bool alloc)
+{
+    uint32_t top = addr >> (SIM_MEM_BLOCK_BITS + SIM_MEM_MID_BITS);
+    uint32_t mid = (addr >> SIM_MEM_BLOCK_BITS) & (SIM_MEM_MID_ENTRIES - 1);
+
+    if (pSim->mem[top] == NULL)
+    {
+        if (!alloc)
+        {
+            return NULL;
+        }
+        pSim->mem[top] = calloc(SIM_MEM_MID_ENTRIES, sizeof(uint8_t *));
+        if (pSim->mem[top] == NULL)
+        {
+            return NULL;
+        }
+    }
+    if ((pSim->mem[top][mid] == NULL) && alloc)
+    {
+        pSim->mem[top][mid] = calloc(1, SIM_MEM_BLOCK_SIZE);
+    }
+    return pSim->mem[top][mid];
+}
+
+static void HbiSimMemFree(HbiSim *pSim)
+{
+    int32_t i, j;
+
+    for (i = 0; i < SIM_MEM_TOP_ENTRIES; i++)
+    {
+        if (pSim->mem[i])
+        {
+            for (j = 0; j < SIM_MEM_MID_ENTRIES; j++)
+            {
+                free(pSim->mem[i][j]);
+            }
+            free(pSim->mem[i]);
+            pSim->mem[i] = NULL;
+        }
+    }
+}
+
+/* firmware started: report it running and publish the ASR memory layout */
+static void HbiSimAppStart(HbiSim *pSim)
+{
+    pSim->appRunning = true;
+    pSim->asrEnabled = true;
+    HbiSimPut16(pSim, SIM_REG_CUR_FWR, ZL380xx_CUR_FW_APP_RUNNING | 1);
+    HbiSimPut32(pSim, SIM_REG_ASR_START, SIM_ASR_AREA_START);
+    HbiSimPut32(pSim, SIM_REG_ASR_END, SIM_ASR_AREA_END);
+    HbiSimPut16(pSim, SIM_REG_ASR_NUM_SEGMENTS, 2);
+    HbiSimPut32(pSim, SIM_REG_ASR_SEGMENT_TABLE, SIM_CODE_SEGMENT_SIZE);
+    HbiSimPut32(pSim, SIM_REG_ASR_SEGMENT_TABLE + 4, SIM_CODE_SEGMENT_ADDR);
+    HbiSimPut32(pSim, SIM_REG_ASR_SEGMENT_TABLE + 8, SIM_ASR_SEGMENT_SIZE);
+    HbiSimPut32(pSim, SIM_REG_ASR_SEGMENT_TABLE + 12, SIM_ASR_SEGMENT_ADDR);
+}
+
+/* device came out of reset into the boot ROM. Registers are cleared, the
+   RAM behind page 255 and the flash contents survive */
+static void HbiSimBootRom(HbiSim *pSim)
+{
+    uint16_t fwrCount = HbiSimGet16(pSim, SIM_REG_FWR_COUNT);
+
+    memset(pSim->reg, 0, sizeof(pSim->reg));
+    pSim->appRunning = false;
+    pSim->asrEnabled = false;
+    pSim->page = 0;
+    HbiSimPut16(pSim, SIM_REG_FWR_COUNT, fwrCount);
+    HbiSimPut16(pSim, SIM_REG_HOST_CMD_RESULT, SIM_BOOT_ROM_SIGNATURE);
+}
+
+/* execute the command in the host command register and post its result */
+static void HbiSimHostCmd(HbiSim *pSim)
+{
+    uint16_t cmd = HbiSimGet16(pSim, SIM_REG_HOST_CMD);
+    uint16_t result = HMI_RESP_SUCCESS;
+    uint16_t fwrCount;
+
+    pSim->stats.hostCmds++;
+
+    switch (cmd)
+    {
+    case SIM_HOST_CMD_LOAD_CMP:
+        result = pSim->appRunning ? HMI_RESP_INV_CMD_APP_IS_RUNNING : HMI_RESP_SUCCESS;
+        break;
+    case SIM_HOST_CMD_FWR_GO:
+        if (pSim->appRunning)
+        {
+            result = HMI_RESP_INV_CMD_APP_IS_RUNNING;
+            break;
+        }
+        HbiSimAppStart(pSim);
+        break;
+    case SIM_HOST_CMD_FLASH_INIT:
+        result = pSim->cfg.noFlash ? HMI_RESP_FLASH_INIT_NO_DEV : HMI_RESP_FLASH_INIT_OK;
+        break;
+    case SIM_HOST_CMD_SAVE_TO_FLASH:
+        if (pSim->cfg.noFlash)
+        {
+            result = HMI_RESP_NO_FLASH_PRESENT;
+            break;
+        }
+        fwrCount = HbiSimGet16(pSim, SIM_REG_FWR_COUNT);
+        HbiSimPut16(pSim, SIM_REG_FWR_COUNT, fwrCount + 1);
+        break;
+    case SIM_HOST_CMD_ERASE_FLASH:
+        if (pSim->cfg.noFlash)
+        {
+            result = HMI_RESP_NO_FLASH_PRESENT;
+            break;
+        }
+        if (HbiSimGet16(pSim, SIM_REG_HOST_CMD_RESULT) != SIM_ERASE_ALL_KEY)
+        {
+            result = HMI_RESP_COMMAND_ERROR;
+            break;
+        }
+        HbiSimPut16(pSim, SIM_REG_FWR_COUNT, 0);
+        /* the flash is re-initialised once erased */
+        result = HMI_RESP_FLASH_INIT_OK;
+        break;
+    case SIM_APP_CMD_ASR_DISABLE:
+    case SIM_APP_CMD_ASR_ENABLE:
+        if (!pSim->appRunning)
+        {
+            result = HMI_RESP_COMMAND_ERROR;
+            break;
+        }
+        pSim->asrEnabled = (cmd == SIM_APP_CMD_ASR_ENABLE);
+        break;
+    default:
+        result = HMI_RESP_COMMAND_ERROR;
+        break;
+    }
+
+    HbiSimPut16(pSim, SIM_REG_HOST_CMD_RESULT, result);
+}
+
+/* complete the pending command or reset once its latency has passed */
+static void HbiSimTick(HbiSim *pSim)
+{
+    if ((pSim->pending == SIM_PENDING_NONE) ||
+        (pSim->cfg.cmdLatencyUs && (HbiSimNowNs() < pSim->pendingDoneNs)))
+    {
+        return;
+    }
+    if (pSim->pending == SIM_PENDING_RESET)
+    {
+        HbiSimBootRom(pSim);
+    }
+    else
+    {
+        HbiSimHostCmd(pSim);
+        HbiSimPut16(pSim, SIM_REG_HOST_CMD, 0);
+        HbiSimPut16(pSim, SIM_REG_SW_FLAGS,
+            HbiSimGet16(pSim, SIM_REG_SW_FLAGS) & ~pSim->pendingNotice);
+    }
+    pSim->pending = SIM_PENDING_NONE;
+}
+
+static void HbiSimStart(HbiSim *pSim, SimPending what, uint16_t notice)
+{
+    pSim->pending = what;
+    pSim->pendingNotice = notice;
+    pSim->pendingDoneNs = HbiSimNowNs() + (uint64_t)pSim->cfg.cmdLatencyUs * 1000;
+    HbiSimTick(pSim);
+}
+
+/* a register word was written by the host */
+static void HbiSimRegWritten(HbiSim *pSim, uint16_t addr)
+{
+    uint16_t val = HbiSimGet16(pSim, addr);
+
+    if (pSim->pending == SIM_PENDING_RESET)
+    {
+        return;
+    }
+    switch (addr)
+    {
+    case SIM_REG_RESET:
+        if (val & 1)
+        {
+            HbiSimStart(pSim, SIM_PENDING_RESET, 0);
+        }
+        break;
+    case SIM_REG_SW_FLAGS:
+        val &= (SIM_SW_FLAGS_HOST_CMD | SIM_SW_FLAGS_APP_CMD);
+        if (val && (pSim->pending == SIM_PENDING_NONE))
+        {
+            HbiSimStart(pSim, SIM_PENDING_CMD, val);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+/* address in page 255 memory of the given byte offset into the window */
+static uint32_t HbiSimMemAddr(HbiSim *pSim, uint8_t offset)
+{
+    return (HbiSimGet32(pSim, SIM_REG_PAGE255_BASE) & 0xFFFFFF00) + offset;
+}
+
+/* store one word at the current address and advance it */
+static void HbiSimPutWord(HbiSim *pSim, uint8_t const *src)
+{
+    uint8_t *pBlock;
+    uint32_t addr = pSim->curAddr;
+
+    /* a device held in reset drops what it is sent */
+    if (pSim->pending == SIM_PENDING_RESET)
+    {
+        pSim->curAddr += 2;
+        return;
+    }
+    if (pSim->curMem)
+    {
+        pBlock = HbiSimMemBlock(pSim, addr, true);
+        if (pBlock)
+        {
+            pBlock[addr & (SIM_MEM_BLOCK_SIZE - 1)] = src[0];
+            pBlock[(addr + 1) & (SIM_MEM_BLOCK_SIZE - 1)] = src[1];
+        }
+    }
+    else
+    {
+        addr &= 0xFFFF;
+        pSim->reg[addr] = src[0];
+        pSim->reg[addr + 1] = src[1];
+        HbiSimRegWritten(pSim, addr);
+    }
+    pSim->curAddr += 2;
+}
+
+/* fetch one word from the current address and advance it */
+static void HbiSimGetWord(HbiSim *pSim, uint8_t *dst)
+{
+    uint8_t *pBlock;
+    uint32_t addr = pSim->curAddr;
+
+    if (pSim->curMem)
+    {
+        pBlock = HbiSimMemBlock(pSim, addr, false);
+        dst[0] = pBlock ? pBlock[addr & (SIM_MEM_BLOCK_SIZE - 1)] : 0;
+        dst[1] = pBlock ? pBlock[(addr + 1) & (SIM_MEM_BLOCK_SIZE - 1)] : 0;
+    }
+    else
+    {
+        addr &= 0xFFFF;
+        dst[0] = pSim->reg[addr];
+        dst[1] = pSim->reg[addr + 1];
+    }
+    pSim->curAddr += 2;
+}
+
+/*********************************************************************************/
+/*  Description: decode the HBI command stream sent during one chip select. A    */
+/*  read command ends the stream, the data clocked out after it lands in rx.     */
+/*********************************************************************************/
+static void HbiSimFrame(HbiSim *pSim, uint8_t const *tx, size_t ntx, uint8_t *rx, size_t nrx)
+{
+    size_t i = 0, n;
+    uint8_t hi, lo;
+
+    pSim->stats.frames++;
+    pSim->stats.txBytes += ntx;
+    pSim->stats.rxBytes += nrx;
+
+    while ((i + 2) <= ntx)
+    {
+        hi = tx[i];
+        lo = tx[i + 1];
+        i += 2;
+
+        if ((hi == SIM_CMD_NOOP) || (hi == SIM_CMD_CONFIGURE))
+        {
+            continue;
+        }
+        if (hi == SIM_CMD_SELECT_PAGE)
+        {
+            pSim->page = (lo != 0xFF) ? (lo + 1) : lo;
+            continue;
+        }
+        if (hi != SIM_CMD_CONT_PAGED_WRITE)
+        {
+            /* direct or paged access, sets the address to work on */
+            if (hi & SIM_CMD_DIRECT)
+            {
+                pSim->curMem = false;
+                pSim->curAddr = (hi & 0x7F) << 1;
+            }
+            else if (pSim->page == 0xFF)
+            {
+                pSim->curMem = true;
+                pSim->curAddr = HbiSimMemAddr(pSim, hi << 1);
+            }
+            else
+            {
+                pSim->curMem = false;
+                pSim->curAddr = ((uint16_t)pSim->page << 8) | (hi << 1);
+            }
+
+            if (!(lo & SIM_CMD_WRITE))
+            {
+                /* the device keeps returning data for as long as it is clocked */
+                for (n = 0; (n + 2) <= nrx; n += 2)
+                {
+                    HbiSimGetWord(pSim, &rx[n]);
+                }
+                return;
+            }
+        }
+
+        n = (((size_t)lo & 0x7F) + 1) << 1;
+        for (; n && ((i + 2) <= ntx); n -= 2, i += 2)
+        {
+            HbiSimPutWord(pSim, &tx[i]);
+        }
+    }
+}
+
+/* account one bus transaction of len bytes and, if a clock is configured,
+   block for as long as it would occupy the bus */
+static void HbiSimWire(HbiSim *pSim, size_t len)
+{
+    struct timespec wake;
+    uint64_t startNs, wireNs;
+
+    pSim->stats.transactions++;
+    if (pSim->cfg.speed == 0)
+    {
+        return;
+    }
+    wireNs = (uint64_t)pSim->cfg.xferOverheadUs * 1000 +
+        ((uint64_t)len * 8 * 1000000000) / pSim->cfg.speed;
+    pSim->stats.wireNs += wireNs;
+
+    /* transactions queue behind each other on the bus */
+    startNs = HbiSimNowNs();
+    if (startNs < pSim->wireEndNs)
+    {
+        startNs = pSim->wireEndNs;
+    }
+    pSim->wireEndNs = startNs + wireNs;
+
+    wake.tv_sec = pSim->wireEndNs / 1000000000;
+    wake.tv_nsec = pSim->wireEndNs % 1000000000;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake, NULL) == EINTR)
+    {
+    }
+}
+
+/* a frame clocked faster than the configured limit is received with bit
+   errors, as on a board whose traces can't carry that clock */
+static void HbiSimGarble(HbiDevice *pDev, uint8_t *rx, size_t nrx, size_t frameLen)
+{
+    HbiSim *pSim = pDev->pPriv;
+    size_t i;
+
+    if ((pSim->cfg.maxSpeed == 0) || (HbiXferSpeed(pDev, frameLen) <= pSim->cfg.maxSpeed))
+    {
+        return;
+    }
+    for (i = 0; i < nrx; i += 3)
+    {
+        rx[i] ^= 0x10;
+    }
+}
+
+/********************************************************************/
+/* 	Open simulated device, it starts with firmware running as if    */
+/*	booted from flash                                               */
+/********************************************************************/
+static bool HbiSimOpen(HbiDevice *pDev)
+{
+    HbiSim *pSim;
+
+    pSim = calloc(1, sizeof(HbiSim));
+    if (pSim == NULL)
+    {
+        printf("can't allocate simulated device");
+        return false;
+    }
+    HbiSimPut16(pSim, SIM_REG_FWR_COUNT, 1);
+    HbiSimAppStart(pSim);
+
+    pDev->pPriv = pSim;
+    return true;
+}
+
+static void HbiSimClose(HbiDevice *pDev)
+{
+    HbiSim *pSim = pDev->pPriv;
+
+    HbiSimMemFree(pSim);
+    free(pSim);
+    pDev->pPriv = NULL;
+}
+
+static bool HbiSimRead(HbiDevice *pDev, void *pSrc, void *pDst, size_t nread, size_t nwrite)
+{
+    HbiSim *pSim = pDev->pPriv;
+
+    HbiSimTick(pSim);
+    HbiSimFrame(pSim, pSrc, nwrite, pDst, nread);
+    HbiSimGarble(pDev, pDst, nread, nwrite + nread);
+    HbiSimWire(pSim, nwrite + nread);
+    return true;
+}
+
+static bool HbiSimWrite(HbiDevice *pDev, uint8_t const *tx, uint8_t const *rx, size_t len)
+{
+    HbiSim *pSim = pDev->pPriv;
+
+    (void)rx;
+    HbiSimTick(pSim);
+    HbiSimFrame(pSim, tx, len, NULL, 0);
+    HbiSimWire(pSim, len);
+    return true;
+}
+
+static bool HbiSimWriteFrame(HbiDevice *pDev, uint8_t const *hdr, size_t nhdr,
+    uint8_t const *data, size_t ndata)
+{
+    HbiSim *pSim = pDev->pPriv;
+    uint8_t buf[4 + ZL380xx_MAX_ACCESS_SIZE_IN_BYTES];
+
+    if ((nhdr + ndata) > sizeof(buf))
+    {
+        return false;
+    }
+    memcpy(&buf[0], hdr, nhdr);
+    memcpy(&buf[nhdr], data, ndata);
+
+    HbiSimTick(pSim);
+    HbiSimFrame(pSim, buf, nhdr + ndata, NULL, 0);
+    HbiSimWire(pSim, nhdr + ndata);
+    return true;
+}
+
+static bool HbiSimBatch(HbiDevice *pDev, HbiBatch *pBatch)
+{
+    HbiSim *pSim = pDev->pPriv;
+    HbiBatchFrame *pFrame;
+    int32_t i;
+
+    HbiSimTick(pSim);
+    for (i = 0; i < pBatch->numFrames; i++)
+    {
+        pFrame = &pBatch->frame[i];
+        HbiSimFrame(pSim, pFrame->tx, pFrame->txLen,
+            pFrame->rx, pFrame->rxLen);
+        HbiSimGarble(pDev, pFrame->rx, pFrame->rxLen, pFrame->txLen + pFrame->rxLen);
+    }
+    HbiSimWire(pSim, pBatch->wireLen);
+    return (++pSim->batches != pSim->cfg.failBatch);
+}
+
+/* returns the simulator state of pDev, NULL if pDev is not simulated */
+static HbiSim *HbiSimGet(HbiDevice *pDev)
+{
+    if ((pDev == NULL) || (pDev->pTransport != &hbiSimTransport))
+    {
+        return NULL;
+    }
+    return pDev->pPriv;
+}
+
+/*********************************************************************************/
+/*  Description: change the behaviour of a simulated device                      */
+/*********************************************************************************/
+HbiStatus HbiSimConfigure(HbiDevice *pDev, HbiSimCfg const *pCfg)
+{
+    HbiSim *pSim = HbiSimGet(pDev);
+
+    if (pSim == NULL)
+    {
+        return HBI_STATUS_BAD_HANDLE;
+    }
+    if (pCfg == NULL)
+    {
+        return HBI_STATUS_INVALID_ARG;
+    }
+    pthread_mutex_lock(&pDev->busLock);
+    pSim->cfg = *pCfg;
+    pSim->batches = 0;
+    pthread_mutex_unlock(&pDev->busLock);
+    return HBI_STATUS_SUCCESS;
+}
+
+/*********************************************************************************/
+/*  Description: read the traffic counters of a simulated device, optionally    */
+/*  clearing them                                                                */
+/*********************************************************************************/
+HbiStatus HbiSimGetStats(HbiDevice *pDev, HbiSimStats *pStats, bool clear)
+{
+    HbiSim *pSim = HbiSimGet(pDev);
+
+    if (pSim == NULL)
+    {
+        return HBI_STATUS_BAD_HANDLE;
+    }
+    pthread_mutex_lock(&pDev->busLock);
+    if (pStats)
+    {
+        *pStats = pSim->stats;
+    }
+    if (clear)
+    {
+        memset(&pSim->stats, 0, sizeof(pSim->stats));
+    }
+    pthread_mutex_unlock(&pDev->busLock);
+    return HBI_STATUS_SUCCESS;
+}
+
+/*********************************************************************************/
+/*  Description: copy size bytes of simulated device memory (the memory reached  */
+/*  through page 255) starting at addr into buf. Memory never written reads 0.   */
+/*********************************************************************************/
+HbiStatus HbiSimReadMem(HbiDevice *pDev, uint32_t addr, uint8_t *buf, size_t size)
+{
+    HbiSim *pSim = HbiSimGet(pDev);
+    uint8_t *pBlock;
+    size_t i;
+
+    if (pSim == NULL)
+    {
+        return HBI_STATUS_BAD_HANDLE;
+    }
+    if (buf == NULL)
+    {
+        return HBI_STATUS_INVALID_ARG;
+    }
+    pthread_mutex_lock(&pDev->busLock);
+    for (i = 0; i < size; i++, addr++)
+    {
+        pBlock = HbiSimMemBlock(pSim, addr, false);
+        buf[i] = pBlock ? pBlock[addr & (SIM_MEM_BLOCK_SIZE - 1)] : 0;
+    }
+    pthread_mutex_unlock(&pDev->busLock);
+    return HBI_STATUS_SUCCESS;
+}
+
+const HbiTransport hbiSimTransport =
+{
+    "sim",
+    HbiSimOpen,
+    HbiSimClose,
+    HbiSimRead,
+    HbiSimWrite,
+    HbiSimWriteFrame,
+    HbiSimBatch,
+    NULL,
+    NULL
+};
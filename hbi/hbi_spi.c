@@ -0,0 +1,660 @@
+/*******************************************************************************
+* Copyright (C) 2021 Microchip Technology Inc. and its subsidiaries.
+*
+* Subject to your compliance with these terms, you may use Microchip software
+* and any derivatives exclusively with Microchip products. It is your
+* responsibility to comply with third party license terms applicable to your
+* use of third party software (including open source software) that may
+* accompany Microchip software.
+*
+* THIS SOFTWARE IS SUPPLIED BY MICROCHIP "AS IS". NO WARRANTIES, WHETHER
+* EXPRESS, IMPLIED OR STATUTORY, APPLY TO THIS SOFTWARE, INCLUDING ANY IMPLIED
+* WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY, AND FITNESS FOR A
+* PARTICULAR PURPOSE.
+*
+* IN NO EVENT WILL MICROCHIP BE LIABLE FOR ANY INDIRECT, SPECIAL, PUNITIVE,
+* INCIDENTAL OR CONSEQUENTIAL LOSS, DAMAGE, COST OR EXPENSE OF ANY KIND
+* WHATSOEVER RELATED TO THE SOFTWARE, HOWEVER CAUSED, EVEN IF MICROCHIP HAS
+* BEEN ADVISED OF THE POSSIBILITY OR THE DAMAGES ARE FORESEEABLE. TO THE
+* FULLEST EXTENT ALLOWED BY LAW, MICROCHIP'S TOTAL LIABILITY ON ALL CLAIMS IN
+* ANY WAY RELATED TO THIS SOFTWARE WILL NOT EXCEED THE AMOUNT OF FEES, IF ANY,
+* THAT YOU HAVE PAID DIRECTLY TO MICROCHIP FOR THIS SOFTWARE.
+*******************************************************************************/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/spi/spidev.h>
+#include "hbi_port.h"
+
+/* HbiSpiCalibrate() defaults */
+#define HBI_SPI_CAL_MIN_SPEED        1000000
+#define HBI_SPI_CAL_MAX_SPEED        50000000
+#define HBI_SPI_CAL_STEP_PCT         10
+#define HBI_SPI_CAL_MARGIN_PCT       20
+#define HBI_SPI_CAL_ROUNDS           8
+#define HBI_SPI_CAL_MAX_BYTES        256
+
+/* spidev refuses a message whose transmitted or received bytes exceed its
+   bufsiz module parameter, every transfer rounded up to HBI_SPIDEV_ALIGN.
+   The number of transfers per SPI_IOC_MESSAGE is limited by the 14-bit
+   ioctl size field */
+#define HBI_SPIDEV_BUFSIZ_PATH       "/sys/module/spidev/parameters/bufsiz"
+#define HBI_SPI_MAX_XFERS            ((1 << _IOC_SIZEBITS) / sizeof(struct spi_ioc_transfer) - 1)
+
+/* one transfer of a frame, tx or rx may be NULL */
+typedef struct
+{
+    void const *tx;
+    void *rx;
+    size_t len;
+}HbiSpiSeg;
+
+/* Transfer planner. Frames are queued into one SPI_IOC_MESSAGE until the
+ * next one would exceed bufsiz on the transmit or receive side or the
+ * transfer limit, then the message is sent and a new one started. A frame
+ * is one chip select assertion and never split across two messages.
+ */
+typedef struct
+{
+    uint32_t n;         /* transfers queued */
+    size_t txTotal;     /* bytes queued to send, as spidev counts them */
+    size_t rxTotal;     /* bytes queued to receive, as spidev counts them */
+    struct spi_ioc_transfer xfer[HBI_SPI_MAX_XFERS];
+}HbiSpiPlan;
+
+/* bufsiz of the spidev driver, the kernel default if it can't be read */
+static uint32_t HbiSpiBufsiz(void)
+{
+    FILE *in;
+    unsigned long bufsiz = 0;
+
+    in = fopen(HBI_SPIDEV_BUFSIZ_PATH, "r");
+    if (in)
+    {
+        if (fscanf(in, "%lu", &bufsiz) != 1)
+        {
+            bufsiz = 0;
+        }
+        fclose(in);
+    }
+    return bufsiz ? (uint32_t)bufsiz : HBI_SPIDEV_BUFSIZ;
+}
+
+/* drop the queued transfers after an error */
+static void HbiSpiDiscard(HbiDevice *pDev)
+{
+    HbiSpiPlan *pPlan = pDev->pPriv;
+
+    pPlan->n = 0;
+    pPlan->txTotal = 0;
+    pPlan->rxTotal = 0;
+}
+
+/* send the queued transfers as one message */
+static bool HbiSpiFlush(HbiDevice *pDev, const char *what)
+{
+    HbiSpiPlan *pPlan = pDev->pPriv;
+    uint32_t n = pPlan->n;
+
+    if (n == 0)
+    {
+        return true;
+    }
+    HbiSpiDiscard(pDev);
+    if (ioctl(pDev->fd, SPI_IOC_MESSAGE(n), pPlan->xfer) < 1)
+    {
+        printf("%s: can't send spi message\n", what);
+        return false;
+    }
+    return true;
+}
+
+/* queue a frame of nseg transfers, sending the message first if the frame
+   does not fit in it any more */
+static bool HbiSpiQueueFrame(HbiDevice *pDev, HbiSpiSeg const *pSeg, uint32_t nseg,
+    const char *what)
+{
+    HbiSpiPlan *pPlan = pDev->pPriv;
+    struct spi_ioc_transfer *pXfer;
+    size_t ntx = 0, nrx = 0, len = 0;
+    uint32_t i, speed;
+
+    for (i = 0; i < nseg; i++)
+    {
+        ntx += pSeg[i].tx ? HbiMsgLen(pDev, pSeg[i].len) : 0;
+        nrx += pSeg[i].rx ? HbiMsgLen(pDev, pSeg[i].len) : 0;
+        len += pSeg[i].len;
+    }
+    if ((ntx > pDev->maxMsg) || (nrx > pDev->maxMsg))
+    {
+        printf("%s: frame of %u bytes exceeds the %u byte spidev bufsiz\n", what,
+            (uint32_t)len, pDev->maxMsg);
+        return false;
+    }
+    if (((pPlan->n + nseg) > HBI_SPI_MAX_XFERS) || ((pPlan->txTotal + ntx) > pDev->maxMsg) ||
+        ((pPlan->rxTotal + nrx) > pDev->maxMsg))
+    {
+        if (!HbiSpiFlush(pDev, what))
+        {
+            return false;
+        }
+    }
+
+    /* deselect the device at the end of the previous frame (cs_change on
+       the last transfer of the message would keep CS asserted instead) */
+    if (pPlan->n)
+    {
+        pPlan->xfer[pPlan->n - 1].cs_change = 1;
+    }
+    speed = HbiXferSpeed(pDev, len);
+    for (i = 0; i < nseg; i++)
+    {
+        pXfer = &pPlan->xfer[pPlan->n++];
+        memset(pXfer, 0, sizeof(*pXfer));
+        pXfer->tx_buf = (unsigned long)pSeg[i].tx;
+        pXfer->rx_buf = (unsigned long)pSeg[i].rx;
+        pXfer->len = pSeg[i].len;
+        pXfer->speed_hz = speed;
+        pXfer->bits_per_word = pDev->bits;
+    }
+    pPlan->txTotal += ntx;
+    pPlan->rxTotal += nrx;
+    return true;
+}
+
+/********************************************************************/
+/* 	Open SPI device				 		                            */
+/*	initialise SPI mode, bits. speed etc                            */
+/* This example implementation is for user-mode linux. This 	    */
+/* code should be ported to the client's specific HW host mcu/mpu   */
+/********************************************************************/
+
+static bool HbiSpiOpen(HbiDevice *pDev)
+{
+    int32_t ret;
+    int32_t handle;
+    uint32_t maxSpeed;
+    handle = open(pDev->path, O_RDWR);
+    if (handle < 0)
+    {
+        printf("can't open device %s", pDev->path);
+        return false;
+    }
+    pDev->fd = handle;
+    pDev->pPriv = calloc(1, sizeof(HbiSpiPlan));
+    if (pDev->pPriv == NULL)
+    {
+        printf("can't allocate spi transfers");
+        goto err;
+    }
+    /* largest message spidev takes, unless the caller knows better */
+    if (pDev->maxMsg == 0)
+    {
+        pDev->maxMsg = HbiSpiBufsiz();
+    }
+    pDev->msgAlign = HBI_SPIDEV_ALIGN;
+
+    /* 					 					 */
+    /*	initialise SPI mode, bits. speed etc */
+
+    /*
+    * spi mode
+    */
+    ret = ioctl(handle, SPI_IOC_WR_MODE, &pDev->mode);
+    if (ret == -1)
+    {
+        printf("can't set spi mode");
+        goto err;
+    }
+
+    ret = ioctl(handle, SPI_IOC_RD_MODE, &pDev->mode);
+    if (ret == -1)
+    {
+        printf("can't get spi mode");
+        goto err;
+    }
+    /*
+    * bits per word
+    */
+    ret = ioctl(handle, SPI_IOC_WR_BITS_PER_WORD, &pDev->bits);
+    if (ret == -1)
+    {
+        printf("can't set bits per word");
+        goto err;
+    }
+    ret = ioctl(handle, SPI_IOC_RD_BITS_PER_WORD, &pDev->bits);
+    if (ret == -1)
+    {
+        printf("can't get bits per word");
+        goto err;
+    }
+    /*
+    * max speed hz, the faster of the command and the bulk clock
+    */
+    maxSpeed = (pDev->bulkSpeed > pDev->speed) ? pDev->bulkSpeed : pDev->speed;
+    ret = ioctl(handle, SPI_IOC_WR_MAX_SPEED_HZ, &maxSpeed);
+    if (ret == -1)
+    {
+        printf("can't set max speed hz");
+        goto err;
+    }
+
+    ret = ioctl(handle, SPI_IOC_RD_MAX_SPEED_HZ, &maxSpeed);
+    if (ret == -1)
+    {
+        printf("can't get max speed hz");
+        goto err;
+    }
+    if (pDev->speed > maxSpeed)
+    {
+        pDev->speed = maxSpeed;
+    }
+    if (pDev->bulkSpeed > maxSpeed)
+    {
+        pDev->bulkSpeed = maxSpeed;
+    }
+    printf("spi mode: 0x%x\n", pDev->mode);
+    printf("bits per word: %u\n", pDev->bits);
+    printf("max speed: %u Hz (%u kHz)\n", (pDev->speed), (pDev->speed) / 1000);
+    if (pDev->bulkSpeed)
+    {
+        printf("bulk speed: %u Hz (%u kHz)\n", (pDev->bulkSpeed), (pDev->bulkSpeed) / 1000);
+    }
+    printf("bufsiz: %u bytes\n", pDev->maxMsg);
+
+    return true;
+
+err:
+    free(pDev->pPriv);
+    pDev->pPriv = NULL;
+    close(handle);
+    return false;
+}
+
+static void HbiSpiClose(HbiDevice *pDev)
+{
+    close(pDev->fd);
+    free(pDev->pPriv);
+    pDev->pPriv = NULL;
+}
+
+/* raise the device clock limit to the faster of the two clocks, each transfer
+   then selects its own clock */
+static bool HbiSpiSetSpeed(HbiDevice *pDev)
+{
+    uint32_t maxSpeed = (pDev->bulkSpeed > pDev->speed) ? pDev->bulkSpeed : pDev->speed;
+
+    if (ioctl(pDev->fd, SPI_IOC_WR_MAX_SPEED_HZ, &maxSpeed) == -1)
+    {
+        printf("can't set max speed hz");
+        return false;
+    }
+    return true;
+}
+
+/*********************************************************************************/
+/* 					Read from Device.							                 */
+/* This example implementation is for user-mode linux. This 	                 */
+/* code should be ported to the client's specific HW host mcu/mpu                */
+/*********************************************************************************/
+static bool HbiSpiRead(HbiDevice *pDev, void *pSrc, void *pDst, size_t nread, size_t nwrite)
+{
+    HbiSpiSeg seg[2] = { { pSrc, NULL, nwrite }, { NULL, pDst, nread } };
+
+    return HbiSpiQueueFrame(pDev, seg, 2, "hbi_spi_read") && HbiSpiFlush(pDev, "hbi_spi_read");
+}
+/*********************************************************************************/
+/* 					Write to Device.							                 */
+/* This example implementation is for user-mode linux. This 	                 */
+/* code should be ported to the client's specific HW host mcu/mpu                */
+/*********************************************************************************/
+static bool HbiSpiWrite(HbiDevice *pDev, uint8_t const *tx, uint8_t const *rx, size_t len)
+{
+    /* rx, if given, receives what the device shifts out during the write */
+    HbiSpiSeg seg = { tx, (void *)rx, len };
+
+    return HbiSpiQueueFrame(pDev, &seg, 1, "hbi_spi_write") && HbiSpiFlush(pDev, "hbi_spi_write");
+}
+/*********************************************************************************/
+/* 					Write a frame header and its payload to Device.              */
+/* This example implementation is for user-mode linux. This 	                 */
+/* code should be ported to the client's specific HW host mcu/mpu                */
+/*********************************************************************************/
+static bool HbiSpiWriteFrame(HbiDevice *pDev, uint8_t const *hdr, size_t nhdr,
+    uint8_t const *data, size_t ndata)
+{
+    /* header and payload are sent back to back under one chip select */
+    HbiSpiSeg seg[2] = { { hdr, NULL, nhdr }, { data, NULL, ndata } };
+
+    return HbiSpiQueueFrame(pDev, seg, 2, "hbi_spi_write") && HbiSpiFlush(pDev, "hbi_spi_write");
+}
+/*********************************************************************************/
+/* 					Send a batch of HBI frames to Device.		                 */
+/* This example implementation is for user-mode linux. This 	                 */
+/* code should be ported to the client's specific HW host mcu/mpu                */
+/*********************************************************************************/
+static bool HbiSpiBatch(HbiDevice *pDev, HbiBatch *pBatch)
+{
+    HbiSpiSeg seg[2];
+    HbiBatchFrame *pFrame;
+    int32_t i;
+
+    /* as few messages as bufsiz and the transfer limit allow */
+    for (i = 0; i < pBatch->numFrames; i++)
+    {
+        pFrame = &pBatch->frame[i];
+        seg[0].tx = pFrame->tx;
+        seg[0].rx = NULL;
+        seg[0].len = pFrame->txLen;
+        seg[1].tx = NULL;
+        seg[1].rx = pFrame->rx;
+        seg[1].len = pFrame->rxLen;
+        if (!HbiSpiQueueFrame(pDev, seg, pFrame->rxLen ? 2 : 1, "hbi_spi_batch"))
+        {
+            HbiSpiDiscard(pDev);
+            return false;
+        }
+    }
+    return HbiSpiFlush(pDev, "hbi_spi_batch");
+}
+
+/*********************************************************************************/
+/*  Description: set the clock of command/status frames (speed) and of bulk      */
+/*  frames (bulkSpeed, 0 to use speed). Takes effect with the next transfer.     */
+/*********************************************************************************/
+HbiStatus HbiSetSpiSpeed(HbiDevice *pDev, uint32_t speed, uint32_t bulkSpeed)
+{
+    uint32_t oldSpeed, oldBulk;
+    HbiStatus status = HBI_STATUS_SUCCESS;
+
+    if (pDev == NULL)
+    {
+        return HBI_STATUS_BAD_HANDLE;
+    }
+    if (speed == 0)
+    {
+        return HBI_STATUS_INVALID_ARG;
+    }
+    pthread_mutex_lock(&pDev->busLock);
+    oldSpeed = pDev->speed;
+    oldBulk = pDev->bulkSpeed;
+    pDev->speed = speed;
+    pDev->bulkSpeed = bulkSpeed;
+    if (pDev->pTransport->setSpeed && !pDev->pTransport->setSpeed(pDev))
+    {
+        pDev->speed = oldSpeed;
+        pDev->bulkSpeed = oldBulk;
+        status = HBI_STATUS_INTERNAL_ERR;
+    }
+    pthread_mutex_unlock(&pDev->busLock);
+    return status;
+}
+
+/* fill buf with test pattern number round, patterns cycle through checker
+   boards, walking ones and pseudo random data */
+static void HbiSpiCalPattern(uint16_t *buf, size_t words, uint32_t round)
+{
+    uint32_t x = round * 0x9E3779B9u + 1;
+    size_t i;
+
+    for (i = 0; i < words; i++)
+    {
+        switch (round & 3)
+        {
+            case 0:
+                buf[i] = (i & 1) ? 0x5555 : 0xAAAA;
+                break;
+            case 1:
+                buf[i] = (i & 1) ? 0xAAAA : 0x5555;
+                break;
+            case 2:
+                buf[i] = (uint16_t)(1u << ((i + round) & 15));
+                break;
+            default:
+                x ^= x << 13;
+                x ^= x >> 17;
+                x ^= x << 5;
+                buf[i] = (uint16_t)x;
+                break;
+        }
+    }
+}
+
+/* true if rounds patterns written to the scratch range read back intact */
+static bool HbiSpiCalCheck(HbiDevice *pDev, HbiSpiCalCfg const *pCfg, uint16_t *wr, uint16_t *rd)
+{
+    uint32_t round;
+
+    for (round = 0; round < pCfg->rounds; round++)
+    {
+        HbiSpiCalPattern(wr, pCfg->size >> 1, round);
+        memset(rd, 0, pCfg->size);
+        if ((HbiWriteBlock(pDev, pCfg->reg, (uint8_t *)wr, pCfg->size) != HBI_STATUS_SUCCESS) ||
+            (HbiReadBlock(pDev, pCfg->reg, (uint8_t *)rd, pCfg->size) != HBI_STATUS_SUCCESS) ||
+            (memcmp(wr, rd, pCfg->size) != 0))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*********************************************************************************/
+/*  Description: find the fastest SPI clock the board carries reliably. The      */
+/*  clock is stepped up from minSpeed, at every step test patterns are written   */
+/*  to the scratch range and read back. The fastest clock that passed, less the  */
+/*  safety margin, is returned in pSpeed and becomes the bulk clock; the command */
+/*  clock is lowered to it if it was faster. The scratch range is restored at    */
+/*  the original clock. Other threads are held off for the whole calibration.    */
+/*  Garbled frames at too fast a clock may reach other registers, so calibrate   */
+/*  before the device is configured.                                             */
+/*********************************************************************************/
+HbiStatus HbiSpiCalibrate(HbiDevice *pDev, HbiSpiCalCfg const *pCfg, uint32_t *pSpeed)
+{
+    HbiSpiCalCfg cfg = { 0 };
+    uint16_t save[HBI_SPI_CAL_MAX_BYTES >> 1];
+    uint16_t wr[HBI_SPI_CAL_MAX_BYTES >> 1];
+    uint16_t rd[HBI_SPI_CAL_MAX_BYTES >> 1];
+    uint32_t origSpeed, origBulk, speed, next, best = 0, result;
+    HbiStatus status;
+
+    if (pDev == NULL)
+    {
+        return HBI_STATUS_BAD_HANDLE;
+    }
+    if (pDev->pTransport == &hbiI2cTransport)
+    {
+        return HBI_STATUS_INVALID_STATE;
+    }
+    if (pCfg)
+    {
+        cfg = *pCfg;
+    }
+    cfg.minSpeed = cfg.minSpeed ? cfg.minSpeed : HBI_SPI_CAL_MIN_SPEED;
+    cfg.maxSpeed = cfg.maxSpeed ? cfg.maxSpeed : HBI_SPI_CAL_MAX_SPEED;
+    cfg.stepPct = cfg.stepPct ? cfg.stepPct : HBI_SPI_CAL_STEP_PCT;
+    cfg.marginPct = cfg.marginPct ? cfg.marginPct : HBI_SPI_CAL_MARGIN_PCT;
+    cfg.rounds = cfg.rounds ? cfg.rounds : HBI_SPI_CAL_ROUNDS;
+    if (cfg.reg == 0)
+    {
+        cfg.reg = 0x000C;
+        cfg.size = cfg.size ? cfg.size : 4;
+    }
+    if ((cfg.size == 0) || (cfg.size > HBI_SPI_CAL_MAX_BYTES) || (cfg.marginPct >= 100) ||
+        (cfg.minSpeed > cfg.maxSpeed))
+    {
+        return HBI_STATUS_INVALID_ARG;
+    }
+
+    status = HbiTransactionBegin(pDev);
+    CHK_STATUS(status);
+    origSpeed = pDev->speed;
+    origBulk = pDev->bulkSpeed;
+
+    status = HbiReadBlock(pDev, cfg.reg, (uint8_t *)save, cfg.size);
+    if (status != HBI_STATUS_SUCCESS)
+    {
+        HbiTransactionEnd(pDev);
+        return status;
+    }
+
+    for (speed = cfg.minSpeed; ; speed = next)
+    {
+        /* a failed step may have left a wrong page or shadow behind */
+        HbiInvalidateCache(pDev);
+        if ((HbiSetSpiSpeed(pDev, speed, speed) != HBI_STATUS_SUCCESS) ||
+            !HbiSpiCalCheck(pDev, &cfg, wr, rd))
+        {
+            break;
+        }
+        best = speed;
+        if (speed >= cfg.maxSpeed)
+        {
+            break;
+        }
+        next = speed + (uint32_t)(((uint64_t)speed * cfg.stepPct) / 100);
+        next = (next > speed) ? next : (speed + 1);
+        next = (next < cfg.maxSpeed) ? next : cfg.maxSpeed;
+    }
+
+    /* back to the known good clock to restore the scratch range */
+    HbiSetSpiSpeed(pDev, origSpeed, origBulk);
+    HbiInvalidateCache(pDev);
+    status = HbiWriteBlock(pDev, cfg.reg, (uint8_t *)save, cfg.size);
+    if (status == HBI_STATUS_SUCCESS)
+    {
+        status = HbiReadBlock(pDev, cfg.reg, (uint8_t *)rd, cfg.size);
+        if ((status == HBI_STATUS_SUCCESS) && (memcmp(save, rd, cfg.size) != 0))
+        {
+            status = HBI_STATUS_INTERNAL_ERR;
+        }
+    }
+    if ((status == HBI_STATUS_SUCCESS) && (best == 0))
+    {
+        printf("SPI calibration failed at %u Hz\n", cfg.minSpeed);
+        status = HBI_STATUS_INTERNAL_ERR;
+    }
+
+    if (status == HBI_STATUS_SUCCESS)
+    {
+        result = best - (uint32_t)(((uint64_t)best * cfg.marginPct) / 100);
+        result = (result > cfg.minSpeed) ? result : cfg.minSpeed;
+        status = HbiSetSpiSpeed(pDev, (origSpeed < result) ? origSpeed : result, result);
+        if (pSpeed)
+        {
+            *pSpeed = result;
+        }
+    }
+    HbiTransactionEnd(pDev);
+    return status;
+}
+
+/*********************************************************************************/
+/*  Description: remember the clocks of pDev in file, one line per device node   */
+/*  ("<path> <speed> <bulkSpeed>"). The entry of the node is replaced, the file  */
+/*  is rewritten atomically.                                                     */
+/*********************************************************************************/
+HbiStatus HbiSpiSpeedSave(HbiDevice *pDev, const char *file)
+{
+    char tmpName[256];
+    char line[160];
+    char path[HBI_PATH_MAX];
+    FILE *in, *out;
+    HbiStatus status = HBI_STATUS_SUCCESS;
+
+    if (pDev == NULL)
+    {
+        return HBI_STATUS_BAD_HANDLE;
+    }
+    if ((file == NULL) || (snprintf(tmpName, sizeof(tmpName), "%s.tmp", file) >= (int)sizeof(tmpName)))
+    {
+        return HBI_STATUS_INVALID_ARG;
+    }
+    out = fopen(tmpName, "w");
+    if (out == NULL)
+    {
+        printf("can't create %s\n", tmpName);
+        return HBI_STATUS_RESOURCE_ERR;
+    }
+
+    /* keep the entries of other devices */
+    in = fopen(file, "r");
+    if (in)
+    {
+        while (fgets(line, sizeof(line), in))
+        {
+            if ((sscanf(line, "%63s", path) == 1) && (strcmp(path, pDev->path) == 0))
+            {
+                continue;
+            }
+            fputs(line, out);
+        }
+        fclose(in);
+    }
+    pthread_mutex_lock(&pDev->busLock);
+    fprintf(out, "%s %u %u\n", pDev->path, pDev->speed, pDev->bulkSpeed);
+    pthread_mutex_unlock(&pDev->busLock);
+
+    if ((fclose(out) != 0) || (rename(tmpName, file) != 0))
+    {
+        remove(tmpName);
+        status = HBI_STATUS_INTERNAL_ERR;
+    }
+    return status;
+}
+
+/*********************************************************************************/
+/*  Description: apply the clocks saved for pDev by HbiSpiSpeedSave(). Returns   */
+/*  HBI_STATUS_RESOURCE_ERR if file has no entry for the device node.            */
+/*********************************************************************************/
+HbiStatus HbiSpiSpeedLoad(HbiDevice *pDev, const char *file)
+{
+    char line[160];
+    char path[HBI_PATH_MAX];
+    uint32_t speed, bulkSpeed;
+    FILE *in;
+    HbiStatus status = HBI_STATUS_RESOURCE_ERR;
+
+    if (pDev == NULL)
+    {
+        return HBI_STATUS_BAD_HANDLE;
+    }
+    if (file == NULL)
+    {
+        return HBI_STATUS_INVALID_ARG;
+    }
+    in = fopen(file, "r");
+    if (in == NULL)
+    {
+        return HBI_STATUS_RESOURCE_ERR;
+    }
+    while (fgets(line, sizeof(line), in))
+    {
+        if ((sscanf(line, "%63s %u %u", path, &speed, &bulkSpeed) == 3) &&
+            (strcmp(path, pDev->path) == 0) && speed)
+        {
+            status = HbiSetSpiSpeed(pDev, speed, bulkSpeed);
+            break;
+        }
+    }
+    fclose(in);
+    return status;
+}
+
+const HbiTransport hbiSpiTransport =
+{
+    "spi",
+    HbiSpiOpen,
+    HbiSpiClose,
+    HbiSpiRead,
+    HbiSpiWrite,
+    HbiSpiWriteFrame,
+    HbiSpiBatch,
+    NULL,
+    HbiSpiSetSpeed
+};
@@ -0,0 +1,152 @@
+/*******************************************************************************
+* Copyright (C) 2021 Microchip Technology Inc. and its subsidiaries.
+*
+* Subject to your compliance with these terms, you may use Microchip software
+* and any derivatives exclusively with Microchip products. It is your
+* responsibility to comply with third party license terms applicable to your
+* use of third party software (including open source software) that may
+* accompany Microchip software.
+*
+* THIS SOFTWARE IS SUPPLIED BY MICROCHIP "AS IS". NO WARRANTIES, WHETHER
+* EXPRESS, IMPLIED OR STATUTORY, APPLY TO THIS SOFTWARE, INCLUDING ANY IMPLIED
+* WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY, AND FITNESS FOR A
+* PARTICULAR PURPOSE.
+*
+* IN NO EVENT WILL MICROCHIP BE LIABLE FOR ANY INDIRECT, SPECIAL, PUNITIVE,
+* INCIDENTAL OR CONSEQUENTIAL LOSS, DAMAGE, COST OR EXPENSE OF ANY KIND
+* WHATSOEVER RELATED TO THE SOFTWARE, HOWEVER CAUSED, EVEN IF MICROCHIP HAS
+* BEEN ADVISED OF THE POSSIBILITY OR THE DAMAGES ARE FORESEEABLE. TO THE
+* FULLEST EXTENT ALLOWED BY LAW, MICROCHIP'S TOTAL LIABILITY ON ALL CLAIMS IN
+* ANY WAY RELATED TO THIS SOFTWARE WILL NOT EXCEED THE AMOUNT OF FEES, IF ANY,
+* THAT YOU HAVE PAID DIRECTLY TO MICROCHIP FOR THIS SOFTWARE.
+*******************************************************************************/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "hbi_port.h"
+
+static const char *hbiStatsOpName[HBI_STATS_NUM_OPS] =
+{
+    "read",
+    "write",
+    "host_cmd",
+    "delay"
+};
+
+uint64_t HbiStatsNowNs(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+/*********************************************************************************/
+/*  Description: add the time elapsed since startNs to the latency histogram of  */
+/*  op. Bucket i counts latencies from 2^i up to 2^(i+1) ns, the last bucket     */
+/*  everything longer. Called with the bus lock held.                            */
+/*********************************************************************************/
+void HbiStatsRecord(HbiStats *pStats, HbiStatsOp op, uint64_t startNs)
+{
+    HbiHistogram *pHist = &pStats->latency[op];
+    uint64_t ns = HbiStatsNowNs() - startNs;
+    uint32_t bucket = 0;
+
+    while (((ns >> bucket) > 1) && (bucket < (HBI_STATS_BUCKETS - 1)))
+    {
+        bucket++;
+    }
+    pHist->bucket[bucket]++;
+    if ((pHist->count == 0) || (ns < pHist->minNs))
+    {
+        pHist->minNs = ns;
+    }
+    if (ns > pHist->maxNs)
+    {
+        pHist->maxNs = ns;
+    }
+    pHist->totalNs += ns;
+    pHist->count++;
+}
+
+/*********************************************************************************/
+/*  Description: copy the counters of pDev into pStats, optionally clearing      */
+/*  them for the next measurement interval                                       */
+/*********************************************************************************/
+HbiStatus HbiStatsGet(HbiDevice *pDev, HbiStats *pStats, bool clear)
+{
+    if (pDev == NULL)
+    {
+        return HBI_STATUS_BAD_HANDLE;
+    }
+    pthread_mutex_lock(&pDev->busLock);
+    if (pStats)
+    {
+        *pStats = pDev->stats;
+    }
+    if (clear)
+    {
+        memset(&pDev->stats, 0, sizeof(pDev->stats));
+    }
+    pthread_mutex_unlock(&pDev->busLock);
+    return HBI_STATUS_SUCCESS;
+}
+
+/*********************************************************************************/
+/*  Description: write pStats to fp as a JSON object. Only histogram buckets     */
+/*  that counted something are listed, each with its lower bound in ns.          */
+/*********************************************************************************/
+void HbiStatsDumpJson(HbiStats const *pStats, FILE *fp)
+{
+    HbiHistogram const *pHist;
+    int32_t op, i;
+    bool first;
+
+    fprintf(fp, "{\n");
+    fprintf(fp, "  \"transactions\": %llu,\n", (unsigned long long)pStats->transactions);
+    fprintf(fp, "  \"frames\": %llu,\n", (unsigned long long)pStats->frames);
+    fprintf(fp, "  \"tx_bytes\": %llu,\n", (unsigned long long)pStats->txBytes);
+    fprintf(fp, "  \"rx_bytes\": %llu,\n", (unsigned long long)pStats->rxBytes);
+    fprintf(fp, "  \"payload_bytes\": %llu,\n", (unsigned long long)pStats->payloadBytes);
+    fprintf(fp, "  \"overhead_bytes\": %llu,\n", (unsigned long long)pStats->overheadBytes);
+    fprintf(fp, "  \"page_selects\": %llu,\n", (unsigned long long)pStats->pageSelects);
+    fprintf(fp, "  \"page_selects_saved\": %llu,\n", (unsigned long long)pStats->pageSelectsSaved);
+    fprintf(fp, "  \"cache_hits\": %llu,\n", (unsigned long long)pStats->cacheHits);
+    fprintf(fp, "  \"cache_misses\": %llu,\n", (unsigned long long)pStats->cacheMisses);
+    fprintf(fp, "  \"writes_skipped\": %llu,\n", (unsigned long long)pStats->writesSkipped);
+    fprintf(fp, "  \"host_cmds\": %llu,\n", (unsigned long long)pStats->hostCmds);
+    fprintf(fp, "  \"host_cmd_errors\": %llu,\n", (unsigned long long)pStats->hostCmdErrors);
+    fprintf(fp, "  \"polls\": %llu,\n", (unsigned long long)pStats->polls);
+    fprintf(fp, "  \"poll_sleeps\": %llu,\n", (unsigned long long)pStats->pollSleeps);
+    fprintf(fp, "  \"errors\": %llu,\n", (unsigned long long)pStats->errors);
+    fprintf(fp, "  \"bus_ns\": %llu,\n", (unsigned long long)pStats->busNs);
+    /* bytes moved while the bus was busy, what the link actually achieved */
+    fprintf(fp, "  \"bus_bytes_per_sec\": %llu,\n", (unsigned long long)(pStats->busNs ?
+        (double)(pStats->txBytes + pStats->rxBytes) * 1e9 / pStats->busNs : 0));
+    fprintf(fp, "  \"latency\": {\n");
+
+    for (op = 0; op < HBI_STATS_NUM_OPS; op++)
+    {
+        pHist = &pStats->latency[op];
+        fprintf(fp, "    \"%s\": { \"count\": %llu, \"total_ns\": %llu, \"min_ns\": %llu, "
+            "\"max_ns\": %llu, \"buckets\": [", hbiStatsOpName[op],
+            (unsigned long long)pHist->count, (unsigned long long)pHist->totalNs,
+            (unsigned long long)pHist->minNs, (unsigned long long)pHist->maxNs);
+
+        first = true;
+        for (i = 0; i < HBI_STATS_BUCKETS; i++)
+        {
+            if (pHist->bucket[i])
+            {
+                fprintf(fp, "%s{ \"ge_ns\": %llu, \"count\": %llu }", first ? " " : ", ",
+                    (unsigned long long)(i ? (1ull << i) : 0),
+                    (unsigned long long)pHist->bucket[i]);
+                first = false;
+            }
+        }
+        fprintf(fp, " ] }%s\n", (op < (HBI_STATS_NUM_OPS - 1)) ? "," : "");
+    }
+    fprintf(fp, "  }\n}\n");
+}
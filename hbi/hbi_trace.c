@@ -0,0 +1,373 @@
+/*******************************************************************************
+* Copyright (C) 2021 Microchip Technology Inc. and its subsidiaries.
+*
+* Subject to your compliance with these terms, you may use Microchip software
+* and any derivatives exclusively with Microchip products. It is your
+* responsibility to comply with third party license terms applicable to your
+* use of third party software (including open source software) that may
+* accompany Microchip software.
+*
+* THIS SOFTWARE IS SUPPLIED BY MICROCHIP "AS IS". NO WARRANTIES, WHETHER
+* EXPRESS, IMPLIED OR STATUTORY, APPLY TO THIS SOFTWARE, INCLUDING ANY IMPLIED
+* WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY, AND FITNESS FOR A
+* PARTICULAR PURPOSE.
+*
+* IN NO EVENT WILL MICROCHIP BE LIABLE FOR ANY INDIRECT, SPECIAL, PUNITIVE,
+* INCIDENTAL OR CONSEQUENTIAL LOSS, DAMAGE, COST OR EXPENSE OF ANY KIND
+* WHATSOEVER RELATED TO THE SOFTWARE, HOWEVER CAUSED, EVEN IF MICROCHIP HAS
+* BEEN ADVISED OF THE POSSIBILITY OR THE DAMAGES ARE FORESEEABLE. TO THE
+* FULLEST EXTENT ALLOWED BY LAW, MICROCHIP'S TOTAL LIABILITY ON ALL CLAIMS IN
+* ANY WAY RELATED TO THIS SOFTWARE WILL NOT EXCEED THE AMOUNT OF FEES, IF ANY,
+* THAT YOU HAVE PAID DIRECTLY TO MICROCHIP FOR THIS SOFTWARE.
+*******************************************************************************/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include "hbi_port.h"
+
+/* Frame trace. Records are written by the thread holding the bus lock, so
+ * there is only ever one producer and it never waits: the ring overwrites
+ * its oldest records when full. HbiTraceFlush() copies records out without
+ * taking the bus lock and afterwards discards any the producer may have
+ * overwritten while they were copied. A flush holds flushLock while it uses
+ * the ring, freeing the ring waits for it.
+ */
+
+#define HBI_TRACE_MIN_RECORDS        64
+
+struct HbiTrace
+{
+    uint32_t         mask;       /* number of records - 1 */
+    _Atomic uint64_t head;       /* records written since enabled */
+    uint64_t         tail;       /* records flushed or dropped */
+    pthread_mutex_t  flushLock;  /* serialises flushes */
+    HbiTraceRec      rec[];
+};
+
+/*********************************************************************************/
+/*  Description: record one frame. The transmitted bytes are tx followed by     */
+/*  data (either may be NULL), rx holds the bytes received. Only the first      */
+/*  HBI_TRACE_DATA_BYTES are kept, transmitted bytes first.                      */
+/*********************************************************************************/
+void HbiTraceFrame(HbiTrace *pTrace, uint64_t startNs, uint64_t endNs, uint8_t flags,
+    uint8_t const *tx, size_t ntx, uint8_t const *data, size_t ndata,
+    uint8_t const *rx, size_t nrx)
+{
+    uint64_t idx = atomic_load_explicit(&pTrace->head, memory_order_relaxed);
+    HbiTraceRec *pRec = &pTrace->rec[idx & pTrace->mask];
+    size_t room = HBI_TRACE_DATA_BYTES;
+    size_t n;
+
+    pRec->startNs = startNs;
+    pRec->durNs = (uint32_t)(endNs - startNs);
+    pRec->seq = (uint32_t)idx;
+    pRec->txLen = (uint16_t)(ntx + ndata);
+    pRec->rxLen = (uint16_t)nrx;
+    pRec->flags = flags;
+
+    n = (ntx < room) ? ntx : room;
+    if (n)
+    {
+        memcpy(&pRec->data[0], tx, n);
+    }
+    pRec->nTx = (uint8_t)n;
+    room -= n;
+
+    n = (ndata < room) ? ndata : room;
+    if (n)
+    {
+        memcpy(&pRec->data[pRec->nTx], data, n);
+    }
+    pRec->nTx += (uint8_t)n;
+    room -= n;
+
+    n = (nrx < room) ? nrx : room;
+    if (n)
+    {
+        memcpy(&pRec->data[pRec->nTx], rx, n);
+    }
+    pRec->nRx = (uint8_t)n;
+
+    atomic_store_explicit(&pTrace->head, idx + 1, memory_order_release);
+}
+
+void HbiTraceFree(HbiTrace *pTrace)
+{
+    if (pTrace)
+    {
+        /* the ring is detached from its device, wait for a flush that
+           picked it up before */
+        pthread_mutex_lock(&pTrace->flushLock);
+        pthread_mutex_unlock(&pTrace->flushLock);
+        pthread_mutex_destroy(&pTrace->flushLock);
+        free(pTrace);
+    }
+}
+
+/*********************************************************************************/
+/*  Description: start tracing every frame sent to pDev into a ring of           */
+/*  numRecords records, rounded up to a power of two. Enabling again starts a    */
+/*  new, empty ring.                                                             */
+/*********************************************************************************/
+HbiStatus HbiTraceEnable(HbiDevice *pDev, uint32_t numRecords)
+{
+    HbiTrace *pTrace, *pOld;
+    uint32_t size = HBI_TRACE_MIN_RECORDS;
+
+    if (pDev == NULL)
+    {
+        return HBI_STATUS_BAD_HANDLE;
+    }
+    if (numRecords > (1u << 24))
+    {
+        return HBI_STATUS_INVALID_ARG;
+    }
+    while (size < numRecords)
+    {
+        size <<= 1;
+    }
+    pTrace = calloc(1, sizeof(HbiTrace) + size * sizeof(HbiTraceRec));
+    if (pTrace == NULL)
+    {
+        return HBI_STATUS_RESOURCE_ERR;
+    }
+    pTrace->mask = size - 1;
+    pthread_mutex_init(&pTrace->flushLock, NULL);
+
+    pthread_mutex_lock(&pDev->busLock);
+    pOld = pDev->pTrace;
+    pDev->pTrace = pTrace;
+    pthread_mutex_unlock(&pDev->busLock);
+
+    HbiTraceFree(pOld);
+    return HBI_STATUS_SUCCESS;
+}
+
+/*********************************************************************************/
+/*  Description: stop tracing and drop the records not flushed yet.             */
+/*********************************************************************************/
+void HbiTraceDisable(HbiDevice *pDev)
+{
+    HbiTrace *pTrace;
+
+    if (pDev == NULL)
+    {
+        return;
+    }
+    pthread_mutex_lock(&pDev->busLock);
+    pTrace = pDev->pTrace;
+    pDev->pTrace = NULL;
+    pthread_mutex_unlock(&pDev->busLock);
+
+    HbiTraceFree(pTrace);
+}
+
+/*********************************************************************************/
+/*  Description: append the records traced since the last flush to fp, preceded */
+/*  by a HbiTraceFileHdr. Does not stop the bus, records overwritten before or   */
+/*  while they are copied are counted in the header as dropped.                  */
+/*********************************************************************************/
+HbiStatus HbiTraceFlush(HbiDevice *pDev, FILE *fp)
+{
+    HbiTrace *pTrace;
+    HbiTraceFileHdr hdr;
+    HbiTraceRec *pCopy;
+    uint64_t size, head, tail, first, i;
+    HbiStatus status = HBI_STATUS_SUCCESS;
+
+    if (pDev == NULL)
+    {
+        return HBI_STATUS_BAD_HANDLE;
+    }
+    if (fp == NULL)
+    {
+        return HBI_STATUS_INVALID_ARG;
+    }
+    /* the ring may be replaced or freed by HbiTraceEnable/Disable(), pick it up
+       under the bus lock and keep it with flushLock */
+    pthread_mutex_lock(&pDev->busLock);
+    pTrace = pDev->pTrace;
+    if (pTrace == NULL)
+    {
+        pthread_mutex_unlock(&pDev->busLock);
+        return HBI_STATUS_INVALID_ARG;
+    }
+    pthread_mutex_lock(&pTrace->flushLock);
+    pthread_mutex_unlock(&pDev->busLock);
+    size = (uint64_t)pTrace->mask + 1;
+
+    head = atomic_load_explicit(&pTrace->head, memory_order_acquire);
+    tail = pTrace->tail;
+    if ((head - tail) > size)
+    {
+        tail = head - size;
+    }
+
+    pCopy = malloc((head - tail) * sizeof(HbiTraceRec) + 1);
+    if (pCopy == NULL)
+    {
+        pthread_mutex_unlock(&pTrace->flushLock);
+        return HBI_STATUS_RESOURCE_ERR;
+    }
+    for (i = tail; i < head; i++)
+    {
+        pCopy[i - tail] = pTrace->rec[i & pTrace->mask];
+    }
+
+    /* whatever the producer got to meanwhile may have overwritten the
+       oldest copies. Record n is written over record n - size, so with
+       record head_now in progress the oldest intact one is head_now - size + 1 */
+    atomic_thread_fence(memory_order_acquire);
+    first = atomic_load_explicit(&pTrace->head, memory_order_relaxed);
+    first = (first >= size) ? (first - size + 1) : 0;
+    if (first < tail)
+    {
+        first = tail;
+    }
+    if (first > head)
+    {
+        first = head;
+    }
+
+    memcpy(hdr.magic, HBI_TRACE_MAGIC, sizeof(hdr.magic));
+    hdr.version = HBI_TRACE_VERSION;
+    hdr.recSize = sizeof(HbiTraceRec);
+    hdr.count = (uint32_t)(head - first);
+    hdr.dropped = (uint32_t)(first - pTrace->tail);
+
+    if ((fwrite(&hdr, sizeof(hdr), 1, fp) != 1) ||
+        (fwrite(&pCopy[first - tail], sizeof(HbiTraceRec), hdr.count, fp) != hdr.count))
+    {
+        status = HBI_STATUS_INTERNAL_ERR;
+    }
+    pTrace->tail = head;
+    pthread_mutex_unlock(&pTrace->flushLock);
+
+    free(pCopy);
+    return status;
+}
+
+/* Full frame capture. Unlike the trace ring every byte sent is kept, written
+ * to a file through stdio as the frames go out, for replay with hbi_replay.
+ */
+
+#define HBI_CAPTURE_BUF_SIZE         (1 << 16)
+
+struct HbiCapture
+{
+    FILE    *fp;
+    uint32_t xfer;     /* number of the current bus transaction */
+    bool     failed;   /* a write to the file failed, capture is incomplete */
+};
+
+/*********************************************************************************/
+/*  Description: append one frame to the capture file. The bytes sent are tx    */
+/*  followed by data. first starts a new bus transaction.                        */
+/*********************************************************************************/
+void HbiCaptureFrame(HbiCapture *pCapture, bool first, uint64_t startNs, uint64_t endNs,
+    uint8_t flags, uint8_t const *tx, size_t ntx, uint8_t const *data, size_t ndata, size_t nrx)
+{
+    HbiCaptureRec rec;
+
+    if (first)
+    {
+        pCapture->xfer++;
+    }
+    memset(&rec, 0, sizeof(rec));
+    rec.startNs = startNs;
+    rec.durNs = (uint32_t)(endNs - startNs);
+    rec.xfer = pCapture->xfer;
+    rec.txLen = (uint16_t)(ntx + ndata);
+    rec.rxLen = (uint16_t)nrx;
+    rec.flags = flags;
+
+    if ((fwrite(&rec, sizeof(rec), 1, pCapture->fp) != 1) ||
+        (ntx && (fwrite(tx, ntx, 1, pCapture->fp) != 1)) ||
+        (ndata && (fwrite(data, ndata, 1, pCapture->fp) != 1)))
+    {
+        pCapture->failed = true;
+    }
+}
+
+void HbiCaptureFree(HbiCapture *pCapture)
+{
+    if (pCapture)
+    {
+        if ((fclose(pCapture->fp) != 0) || pCapture->failed)
+        {
+            printf("capture file incomplete\n");
+        }
+        free(pCapture);
+    }
+}
+
+/*********************************************************************************/
+/*  Description: write every frame sent to pDev from now on to the file at path, */
+/*  replacing it. A capture already running is stopped first.                    */
+/*********************************************************************************/
+HbiStatus HbiCaptureStart(HbiDevice *pDev, const char *path)
+{
+    HbiCapture *pCapture, *pOld;
+    HbiCaptureFileHdr hdr;
+
+    if (pDev == NULL)
+    {
+        return HBI_STATUS_BAD_HANDLE;
+    }
+    if (path == NULL)
+    {
+        return HBI_STATUS_INVALID_ARG;
+    }
+    pCapture = calloc(1, sizeof(HbiCapture));
+    if (pCapture == NULL)
+    {
+        return HBI_STATUS_RESOURCE_ERR;
+    }
+    pCapture->fp = fopen(path, "wb");
+    if (pCapture->fp == NULL)
+    {
+        free(pCapture);
+        return HBI_STATUS_RESOURCE_ERR;
+    }
+    setvbuf(pCapture->fp, NULL, _IOFBF, HBI_CAPTURE_BUF_SIZE);
+
+    memcpy(hdr.magic, HBI_CAPTURE_MAGIC, sizeof(hdr.magic));
+    hdr.version = HBI_CAPTURE_VERSION;
+    hdr.recSize = sizeof(HbiCaptureRec);
+    if (fwrite(&hdr, sizeof(hdr), 1, pCapture->fp) != 1)
+    {
+        fclose(pCapture->fp);
+        free(pCapture);
+        return HBI_STATUS_INTERNAL_ERR;
+    }
+
+    pthread_mutex_lock(&pDev->busLock);
+    pOld = pDev->pCapture;
+    pDev->pCapture = pCapture;
+    pthread_mutex_unlock(&pDev->busLock);
+
+    HbiCaptureFree(pOld);
+    return HBI_STATUS_SUCCESS;
+}
+
+/*********************************************************************************/
+/*  Description: stop capturing and close the capture file                      */
+/*********************************************************************************/
+void HbiCaptureStop(HbiDevice *pDev)
+{
+    HbiCapture *pCapture;
+
+    if (pDev == NULL)
+    {
+        return;
+    }
+    pthread_mutex_lock(&pDev->busLock);
+    pCapture = pDev->pCapture;
+    pDev->pCapture = NULL;
+    pthread_mutex_unlock(&pDev->busLock);
+
+    HbiCaptureFree(pCapture);
+}
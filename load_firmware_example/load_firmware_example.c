@@ -25,11 +25,16 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include <getopt.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "hbi.h"
 
 #define MAX_HBI_BYTES_PER_ACCESS               256
-#define HBI_BUFFER_SIZE                        256
 
 /* TW firmware bin image header description */
 /* header field width in bytes */
@@ -58,9 +63,13 @@
 #define IMG_HDR_TYPE_SHIFT    6
 #define IMG_HDR_ENDIAN_SHIFT  5	
 
-/* These tables are generated using twConvertFirmware2c.c file */
+/* These tables are generated using twConvertFirmware2c.c file, they are
+   built in with TW_BUILTIN_IMAGES (make BUILTIN_IMAGES=1) and loaded when
+   no image files are given on the command line */
+#ifdef TW_BUILTIN_IMAGES
 extern const unsigned char config[];
 extern const unsigned char fwr[];
+#endif
 
 typedef enum
 {
@@ -85,21 +94,28 @@ typedef struct
     int    hdr_len;    /*!< length of header */
 }hbi_img_hdr_t;
 
-static unsigned char image[HBI_BUFFER_SIZE];
+/*! \brief image file mapped into memory
+ *
+ */
+typedef struct
+{
+    const unsigned char *pData; /*!< header followed by the image blocks */
+    size_t               size;  /*!< file size in bytes */
+}twImageFile;
 
-static inline HbiStatus twBootConclude(int32_t fd)
+static inline HbiStatus twBootConclude(HbiDevice *pDev)
 {
     uint16_t                val = 0;
     HbiStatus status = HBI_STATUS_SUCCESS;
     ZL380xx_HMI_RESPONSE hmi_response;
 
     /*HOST_CMD_HOST_LOAD_CMP*/
-    status = HbiWriteHostCmd(fd, 0x000D); /*loading complete*/
+    status = HbiWriteHostCmd(pDev, 0x000D); /*loading complete*/
     CHK_STATUS(status);
 
     /*Checks the status register to know result of command issued    */
     /*0x0034 Host Command Param/Result register*/
-    status = HbiRead(fd, 0x0034, (uint8_t  *)&val, sizeof(val));
+    status = HbiRead(pDev, 0x0034, (uint8_t  *)&val, sizeof(val));
     hmi_response = (int32_t)val;
     printf("hmi_response status %d\n", hmi_response);
     switch (hmi_response)
@@ -111,20 +127,29 @@ static inline HbiStatus twBootConclude(int32_t fd)
     }
     return HBI_STATUS_COMMAND_ERR;
 }
-static HbiStatus HbiResetToBoot(int32_t fd)
+static HbiStatus HbiResetToBoot(HbiDevice *pDev)
 {
     HbiStatus status = HBI_STATUS_SUCCESS;
     uint16_t     val = 0;
+    /* sleep 0.1 ms doubling up to 5 ms between polls, give up after 50 ms */
+    const HbiPollCfg resetPollCfg = { 0, 100, 5000, 50 };
+
+    /*clear the boot ROM signature left by an earlier reset, so that only
+      the reset ordered here can post it again*/
+    status = HbiWrite(pDev, 0x0034, (uint8_t *)&val, 2);
+    CHK_STATUS(status);
 
     val = 1;
-    status = HbiWrite(fd, 0x014, (uint8_t *)&val, 2); /*go to boot rom mode*/
+    status = HbiWrite(pDev, 0x014, (uint8_t *)&val, 2); /*go to boot rom mode*/
+    CHK_STATUS(status);
 
-    /*required for the reset to cmplete. */
-    HbiPortDelay(50);
+    /*device state cached by the driver does not survive the reset*/
+    HbiInvalidateCache(pDev);
 
-    /*check whether the device has gone into boot mode as ordered*/
-    status = HbiRead(fd, 0x0034, (uint8_t *)&val, 2);
-    if (status != HBI_STATUS_SUCCESS)
+    /*check whether the device has gone into boot mode as ordered, it
+      takes up to 50 ms for the reset to complete */
+    status = HbiPollReg(pDev, 0x0034, 0xFFFF, 0xD3D3, true, &resetPollCfg, &val);
+    if ((status != HBI_STATUS_SUCCESS) && (status != HBI_STATUS_OP_INCOMPLETE))
     {
         printf("HBI Read Failed \n");
         return HBI_STATUS_INTERNAL_ERR;
@@ -138,62 +163,117 @@ static HbiStatus HbiResetToBoot(int32_t fd)
     return status;
 
 }
-HbiStatus HbiSwitchToBootMode(int32_t fd)
+HbiStatus HbiSwitchToBootMode(HbiDevice *pDev)
 {
     uint16_t      val1 = 0;
     HbiStatus  status;
     int32_t       boot_stat = 1;
     /* read the app running status bit from reg 0x28 "Currently Loaded Firmware Reg" */
-    status = HbiRead(fd, 0x0028, (uint8_t *)&val1, sizeof(val1));
+    status = HbiRead(pDev, 0x0028, (uint8_t *)&val1, sizeof(val1));
     //val1 = HBI_VAL(HBI_DEV_ENDIAN_BIG, val1);
     if (val1 & ZL380xx_CUR_FW_APP_RUNNING)
         boot_stat = 0;
     if (!boot_stat)
     {
         /* put device in boot rom mode */
-        status = HbiResetToBoot(fd);
+        status = HbiResetToBoot(pDev);
     }
     return status;
 }
-static HbiStatus twBootWrite(int32_t fd, void *pData, int32_t size)
+/* Boot session of one firmware load. The device is reset into the boot ROM
+ * before the first block, whatever it is running at the time, and the
+ * blocks are then streamed without asking the device for its mode again.
+ * A failed block leaves an unknown part of the image in the device and
+ * possibly another page selected, so the load is never resumed where it
+ * failed: the device is reset into the boot ROM again and the image is
+ * sent from its first block.
+ */
+#define TW_BOOT_MAX_RESTARTS    1
+
+typedef struct
 {
-    HbiStatus        status = HBI_STATUS_SUCCESS;
-    unsigned char       *pFwrData;
-    size_t               len;
-    int32_t              ret;
-    int32_t 				stat = 0;
-    uint16_t                val = 0;
-    int32_t                 boot_stat = 1;
-    pFwrData = (unsigned char *)(pData);
-    len = size;
+    HbiDevice *pDev;
+    int        restarts;  /* loads left to start over after a failed block */
+}twBootSession;
 
-    status = HbiSwitchToBootMode(fd);
-    CHK_STATUS(status);
+static HbiStatus twBootBegin(twBootSession *pSession)
+{
+    return HbiResetToBoot(pSession->pDev);
+}
 
-    stat = HbiPortWrite(fd, pFwrData, NULL, len);
-    if (stat < 0)
+/* after a failed block: start the load over from a fresh boot ROM */
+static HbiStatus twBootRestart(twBootSession *pSession)
+{
+    if (pSession->restarts <= 0)
     {
-        status = HBI_STATUS_INTERNAL_ERR;
+        return HBI_STATUS_INTERNAL_ERR;
+    }
+    pSession->restarts--;
+    printf("Firmware block failed, restarting the load from the boot ROM\n");
+    return twBootBegin(pSession);
+}
+
+/* number of consecutive image blocks sent in one bus transaction, as many as
+   fit in a batch of pDev, i.e. in one message of its bus, counted the way
+   the bus counts them. A block too large for a batch goes out on its own. */
+static uint32_t twBlocksPerWrite(HbiDevice *pDev, uint32_t block_size)
+{
+    uint32_t num = (uint32_t)(HbiBatchMaxBytes(pDev) / HbiBatchFrameBytes(pDev, block_size, 0));
+
+    if (num > (uint32_t)HbiBatchMaxFrames(pDev))
+    {
+        num = (uint32_t)HbiBatchMaxFrames(pDev);
+    }
+    return num ? num : 1;
+}
+
+/* send num consecutive blocks of block_size bytes from pData in one bus
+   transaction. The blocks are queued by reference, straight out of the
+   image, and the SPI transport packs them into a single message with the
+   chip select toggled between blocks. */
+static HbiStatus twWriteBlocks(HbiDevice *pDev, const unsigned char *pData,
+    uint32_t block_size, uint32_t num)
+{
+    HbiStatus   status;
+    HbiBatch    batch;
+    uint32_t    i;
+
+    if (HbiBatchFrameBytes(pDev, block_size, 0) > HbiBatchMaxBytes(pDev))
+    {
+        return HbiPortWrite(pDev, pData, NULL, block_size) ?
+            HBI_STATUS_SUCCESS : HBI_STATUS_INTERNAL_ERR;
     }
 
+    status = HbiBatchBegin(pDev, &batch);
+    CHK_STATUS(status);
+    for (i = 0; (status == HBI_STATUS_SUCCESS) && (i < num); i++)
+    {
+        status = HbiBatchAppendRaw(&batch, &pData[i * block_size], block_size);
+    }
+    if (status == HBI_STATUS_SUCCESS)
+    {
+        status = HbiBatchSubmit(&batch);
+    }
+    HbiBatchEnd(&batch);
     return status;
 }
-static inline HbiStatus  twStartFwrFromRam(int fd)
+
+static inline HbiStatus  twStartFwrFromRam(HbiDevice *pDev)
 {
     int32_t  ret;
     HbiStatus status = HBI_STATUS_SUCCESS;
     ZL380xx_HMI_RESPONSE    hmi_response;
     uint16_t                val = 0;
 
-    status = HbiSwitchToBootMode(fd);
+    status = HbiSwitchToBootMode(pDev);
     CHK_STATUS(status);
 
-    status = HbiWriteHostCmd(fd, 0x08/*HOST_CMD_FWR_GO*/);
+    status = HbiWriteHostCmd(pDev, 0x08/*HOST_CMD_FWR_GO*/);
     CHK_STATUS(status);
 
     /*Checks the status register to know result of command issued    */
     /*0x0034 Host Command Param/Result register*/
-    status = HbiRead(fd, 0x0034, (uint8_t  *)&val, sizeof(val));
+    status = HbiRead(pDev, 0x0034, (uint8_t  *)&val, sizeof(val));
     hmi_response = (int32_t)val;
     if (hmi_response != HMI_RESP_SUCCESS)
     {
@@ -203,25 +283,12 @@ static inline HbiStatus  twStartFwrFromRam(int fd)
     return status;
 }
 
-static HbiStatus twConfigWrite(int32_t fd, void *pData, int32_t size)
+static HbiStatus twConfigWrite(HbiDevice *pDev, const unsigned char *pData,
+    uint32_t block_size, uint32_t num)
 {
-    HbiStatus        status = HBI_STATUS_SUCCESS;
-    unsigned char       *pCfgData;
-    size_t               len;
-    int 					ret = 0;
-
-    pCfgData = (unsigned char *)(pData);
-    len = size;
-
-    ret = HbiPortWrite(fd, pCfgData, NULL, len);
-    if (ret < 1)
-    {
-        status = HBI_STATUS_INTERNAL_ERR;
-    }
-
-    return status;
+    return twWriteBlocks(pDev, pData, block_size, num);
 }
-static inline HbiStatus twSaveFwrcfgToFlash(int32_t fd,
+static inline HbiStatus twSaveFwrcfgToFlash(HbiDevice *pDev,
     void *pVal)
 {
     HbiStatus               status;
@@ -230,16 +297,16 @@ static inline HbiStatus twSaveFwrcfgToFlash(int32_t fd,
     int32_t                 ret;
     uint16_t                val;
 
-    status = HbiSwitchToBootMode(fd);
+    status = HbiSwitchToBootMode(pDev);
     CHK_STATUS(status);
 
     /* if there is a flash on board initialize it HOST_CMD_HOST_FLASH_INIT */
-    status = HbiWriteHostCmd(fd, HOST_CMD_HOST_FLASH_INIT);
+    status = HbiWriteHostCmd(pDev, HOST_CMD_HOST_FLASH_INIT);
     CHK_STATUS(status);
 
     /*Checks the status register to know result of command issued    */
     /*0x0034 Host Command Param/Result register*/
-    status = HbiRead(fd, 0x0034, (uint8_t  *)&val, sizeof(val));
+    status = HbiRead(pDev, 0x0034, (uint8_t  *)&val, sizeof(val));
     hmi_response = (int32_t)val;
     switch (hmi_response)
     {
@@ -254,7 +321,7 @@ static inline HbiStatus twSaveFwrcfgToFlash(int32_t fd,
 
     val = 0;
     /* 0x01F2 - ZL380xx_CFG_REC_CHKSUM_REG*/
-    status = HbiWrite(fd, 0x01F2, (uint8_t  *)&val, 2);
+    status = HbiWrite(pDev, 0x01F2, (uint8_t  *)&val, 2);
     if (status != HBI_STATUS_SUCCESS)
     {
         printf("ERROR %d: \n", status);
@@ -262,12 +329,12 @@ static inline HbiStatus twSaveFwrcfgToFlash(int32_t fd,
     }
 
     /*save the image to flash*/
-    status = HbiWriteHostCmd(fd, 0x04);
+    status = HbiWriteHostCmd(pDev, 0x04);
     CHK_STATUS(status);
 
     /*Checks the status register to know result of command issued    */
     /*0x0034 Host Command Param/Result register*/
-    status = HbiRead(fd, 0x0034, (uint8_t  *)&val, sizeof(val));
+    status = HbiRead(pDev, 0x0034, (uint8_t  *)&val, sizeof(val));
     hmi_response = (int32_t)val;
 
     if (hmi_response != HMI_RESP_SUCCESS)
@@ -283,7 +350,7 @@ static inline HbiStatus twSaveFwrcfgToFlash(int32_t fd,
     if (pVal)
     {
         /* 0x0026 ZL380xx_FWR_COUNT_REG*/
-        status = HbiRead(fd, 0x0026, (uint8_t *)&num_fwr_images, 2);
+        status = HbiRead(pDev, 0x0026, (uint8_t *)&num_fwr_images, 2);
         CHK_STATUS(status);
 
         *(int *)pVal = num_fwr_images;
@@ -292,7 +359,7 @@ static inline HbiStatus twSaveFwrcfgToFlash(int32_t fd,
     return status;
 
 }
-HbiStatus getHeader(unsigned char *pData, hbi_img_hdr_t *pHdr)
+HbiStatus getHeader(const unsigned char *pData, hbi_img_hdr_t *pHdr)
 {
 
 
@@ -321,29 +388,83 @@ HbiStatus getHeader(unsigned char *pData, hbi_img_hdr_t *pHdr)
     return HBI_STATUS_SUCCESS;
 }
 
-HbiStatus vprocLoadImage(int32_t fd, const unsigned char *loadPtr) {
+static void twImageUnmap(twImageFile *pImg)
+{
+    if (pImg->pData)
+    {
+        munmap((void *)pImg->pData, pImg->size);
+    }
+    pImg->pData = NULL;
+    pImg->size = 0;
+}
 
-    HbiStatus   status = HBI_STATUS_SUCCESS;
-    size_t         len;
-    int            i;
-    int             c, dataLen;
-    unsigned char  *pData;
-    uint32_t        block_size, data_size;
+/* map a .bin image written by twConvertFirmware2c read only. The header is
+   checked against the file size, so streaming the blocks never reads past
+   the mapping, and the pages are only read in as the blocks are sent */
+static HbiStatus twImageMap(const char *path, hbi_img_type_t type, twImageFile *pImg)
+{
+    struct stat     st;
     hbi_img_hdr_t   hdr;
-    size_t          fwr_len;
+    void           *pMap;
+    int             fd;
 
-    /* init to null on safer side*/
-    pData = image;
+    pImg->pData = NULL;
+    pImg->size = 0;
 
-    for (i = 0; i < HBI_BUFFER_SIZE; i++)
+    fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        printf("can't open image %s: %s\n", path, strerror(errno));
+        return HBI_STATUS_INVALID_ARG;
+    }
+    if ((fstat(fd, &st) < 0) || (st.st_size < IMG_HDR_LEN))
+    {
+        printf("%s is not an image file\n", path);
+        close(fd);
+        return HBI_STATUS_INVALID_ARG;
+    }
+    pMap = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (pMap == MAP_FAILED)
     {
-        pData[i] = loadPtr[i];
+        printf("can't map image %s: %s\n", path, strerror(errno));
+        return HBI_STATUS_RESOURCE_ERR;
     }
+    /* blocks are sent once, front to back */
+    madvise(pMap, st.st_size, MADV_SEQUENTIAL);
+    pImg->pData = pMap;
+    pImg->size = st.st_size;
+
+    if ((getHeader(pImg->pData, &hdr) != HBI_STATUS_SUCCESS) || (hdr.image_type != type) ||
+        (hdr.block_size == 0) || ((hdr.img_len % (hdr.block_size * 2)) != 0) ||
+        ((hdr.hdr_len + hdr.img_len) > pImg->size))
+    {
+        printf("%s is not a valid %s image\n", path,
+            (type == HBI_IMG_TYPE_FWR) ? "firmware" : "configuration record");
+        twImageUnmap(pImg);
+        return HBI_STATUS_INVALID_ARG;
+    }
+    return HBI_STATUS_SUCCESS;
+}
+
+HbiStatus vprocLoadImage(HbiDevice *pDev, const unsigned char *loadPtr) {
+
+    HbiStatus   status = HBI_STATUS_SUCCESS;
+    size_t         len;
+    int             dataLen;
+    const unsigned char *pData;
+    uint32_t        block_size, num, blocksPerWrite;
+    hbi_img_hdr_t   hdr;
+    size_t          fwr_len;
+    twBootSession   session = { pDev, TW_BOOT_MAX_RESTARTS };
+
     /*Firmware image is organised into chunks of fixed length and this information
       is embedded in image header. Thus first read image header and
-      then start reading chunks and loading on to device
+      then start reading chunks and loading on to device. The image is sent
+      straight from loadPtr, the transport takes const data so no block is
+      copied on the way
       */
-    status = getHeader(pData, &hdr);
+    status = getHeader(loadPtr, &hdr);
     if (status != HBI_STATUS_SUCCESS)
     {
         printf("HBI_get_header() err 0x%x \n", status);
@@ -352,15 +473,28 @@ HbiStatus vprocLoadImage(int32_t fd, const unsigned char *loadPtr) {
 
     /* length is in unit of 16-bit words */
     block_size = (hdr.block_size) * 2;
-    data_size = block_size;
     fwr_len = hdr.img_len;
+    blocksPerWrite = twBlocksPerWrite(pDev, block_size);
 
-    if (block_size > HBI_BUFFER_SIZE)
+    /* every block goes out within one bus message */
+    if (HbiBatchFrameBytes(pDev, block_size, 0) > HbiBatchMaxBytes(pDev))
     {
-        printf("Insufficient buffer size. please recompiled with increased HBI_BUFFER_SIZE\n");
+        printf("Image block of %u bytes exceeds the %u byte bus transfer limit\n",
+            block_size, (uint32_t)HbiBatchMaxBytes(pDev));
         return HBI_STATUS_RESOURCE_ERR;
     }
 
+    /* a firmware image goes to a freshly reset boot ROM */
+    if (hdr.image_type == HBI_IMG_TYPE_FWR)
+    {
+        status = twBootBegin(&session);
+        if (status != HBI_STATUS_SUCCESS)
+        {
+            printf("Error %d:HbiResetToBoot\n", status);
+            return status;
+        }
+    }
+
     printf("\nSending image data ...\n");
 
     /* skip header from file.
@@ -371,21 +505,31 @@ HbiStatus vprocLoadImage(int32_t fd, const unsigned char *loadPtr) {
 
     while (len < fwr_len)
     {
-        for (i = 0; i < block_size; i++)
+        /* coalesce the consecutive blocks that fit in one transaction */
+        pData = &loadPtr[dataLen];
+        num = (fwr_len - len + block_size - 1) / block_size;
+        if (num > blocksPerWrite)
         {
-            pData[i] = loadPtr[dataLen + i];
+            num = blocksPerWrite;
         }
-        dataLen += block_size;
-        len += block_size;
-
+        dataLen += num * block_size;
+        len += num * block_size;
 
         if (hdr.image_type == HBI_IMG_TYPE_FWR)
         {
-            status = twBootWrite(fd, pData, data_size);/* HBI_CMD_LOAD_FWR_FROM_HOST */
+            status = twWriteBlocks(pDev, pData, block_size, num);/* HBI_CMD_LOAD_FWR_FROM_HOST */
+            if ((status != HBI_STATUS_SUCCESS) &&
+                (twBootRestart(&session) == HBI_STATUS_SUCCESS))
+            {
+                /* back in the boot ROM, send the image from its first block */
+                len = 0;
+                dataLen = hdr.hdr_len;
+                continue;
+            }
         }
         else if (hdr.image_type == HBI_IMG_TYPE_CR)
         {
-            status = twConfigWrite(fd, pData, data_size); /*HBI_CMD_LOAD_CFGREC_FROM_HOST */
+            status = twConfigWrite(pDev, pData, block_size, num); /*HBI_CMD_LOAD_CFGREC_FROM_HOST */
         }
         else {
             printf("Error %d:Unrecognized image type %d\n", status, hdr.image_type);
@@ -400,7 +544,7 @@ HbiStatus vprocLoadImage(int32_t fd, const unsigned char *loadPtr) {
 
     if (hdr.image_type == HBI_IMG_TYPE_FWR)
     {
-        status = twBootConclude(fd);
+        status = twBootConclude(pDev);
         if (status != HBI_STATUS_SUCCESS) {
             printf("Error 1 %d:HBI_set_command(HBI_CMD_START_FWR)\n", status);
             return status;
@@ -411,7 +555,15 @@ HbiStatus vprocLoadImage(int32_t fd, const unsigned char *loadPtr) {
     return HBI_STATUS_SUCCESS;
 }
 
-void main(void)
+/* the simulator test links the loader without its command line */
+#ifndef TW_LOADER_NO_MAIN
+static void usage(const char *name)
+{
+    printf("Usage: %s [-d device] [-f firmware.bin] [-c config.bin]\n"
+        "  without -f and -c the fwr and config tables built in with BUILTIN_IMAGES=1 are loaded\n", name);
+}
+
+int main(int argc, char** argv)
 {
     HbiStatus  status;
     int  bSaveToFlash = 1; /* set it to zero to skip save to flash functionality*/
@@ -419,35 +571,117 @@ void main(void)
     int fwrLoaded = 0, cfgrecLoaded = 0;
     int imageNum;
     int ret;
+    int exitCode = 0; /* non-zero once any step failed */
+#ifdef TW_BUILTIN_IMAGES
     const unsigned char * fwrAddress = &fwr[0];
     const unsigned char * configAddress = &config[0];
-    int fd;
-
-    ret = HbiPortOpen(&fd);
+#else
+    const unsigned char * fwrAddress = NULL;
+    const unsigned char * configAddress = NULL;
+#endif
+    const char *fwrPath = NULL, *configPath = NULL;
+    twImageFile fwrFile = { NULL, 0 }, configFile = { NULL, 0 };
+    HbiDeviceCfg cfg = { 0 };
+    HbiDevice *pDev;
+
+    while ((c = getopt(argc, argv, "d:f:c:h")) != -1)
+    {
+        switch (c)
+        {
+        case 'd':
+            cfg.path = optarg;
+            break;
+        case 'f':
+            fwrPath = optarg;
+            break;
+        case 'c':
+            configPath = optarg;
+            break;
+        default:
+            usage(argv[0]);
+            return (c == 'h') ? 0 : -1;
+        }
+    }
 
-    status = vprocLoadImage(fd, fwrAddress);
-    if (status == HBI_STATUS_SUCCESS)
+    /* with image files given, only those are loaded, straight from the
+       mapped files */
+    if (fwrPath || configPath)
     {
-        fwrLoaded = 1;
+        fwrAddress = NULL;
+        configAddress = NULL;
     }
-    else
+    else if ((fwrAddress == NULL) && (configAddress == NULL))
     {
-        printf("Error loading firmware\n");
-        HbiPortClose(fd);
-        return;
+        printf("No images built in, give them with -f and -c\n");
+        usage(argv[0]);
+        return -1;
+    }
+    if (fwrPath)
+    {
+        if (twImageMap(fwrPath, HBI_IMG_TYPE_FWR, &fwrFile) != HBI_STATUS_SUCCESS)
+        {
+            return -1;
+        }
+        fwrAddress = fwrFile.pData;
+    }
+    if (configPath)
+    {
+        if (twImageMap(configPath, HBI_IMG_TYPE_CR, &configFile) != HBI_STATUS_SUCCESS)
+        {
+            twImageUnmap(&fwrFile);
+            return -1;
+        }
+        configAddress = configFile.pData;
     }
 
-    printf("Loading Configuration Record...\n");
+    ret = HbiPortOpen(&pDev, &cfg);
+    if (ret == 0)
+    {
+        printf("HbiPortOpen ERROR\n");
+        twImageUnmap(&fwrFile);
+        twImageUnmap(&configFile);
+        return -1;
+    }
 
-    status = vprocLoadImage(fd, configAddress);
-    if (status == HBI_STATUS_SUCCESS)
+    if (fwrAddress)
     {
-        printf("Config Loading Done.\n");
-        cfgrecLoaded = 1;
+        /* the image stream continues device state from one block to the next,
+           keep other users of the device out while it is loaded */
+        HbiTransactionBegin(pDev);
+        status = vprocLoadImage(pDev, fwrAddress);
+        HbiTransactionEnd(pDev);
+        twImageUnmap(&fwrFile);
+        if (status == HBI_STATUS_SUCCESS)
+        {
+            fwrLoaded = 1;
+        }
+        else
+        {
+            printf("Error loading firmware\n");
+            twImageUnmap(&configFile);
+            HbiPortClose(pDev);
+            return -1;
+        }
     }
-    else
+
+    if (configAddress)
     {
-        printf("Error loading config record\n");
+        printf("Loading Configuration Record...\n");
+
+        HbiTransactionBegin(pDev);
+        status = vprocLoadImage(pDev, configAddress);
+        HbiTransactionEnd(pDev);
+        twImageUnmap(&configFile);
+        if (status == HBI_STATUS_SUCCESS)
+        {
+            printf("Config Loading Done.\n");
+            cfgrecLoaded = 1;
+        }
+        else
+        {
+            printf("Error loading config record\n");
+            exitCode = -1;
+        }
     }
 
     if (fwrLoaded)
@@ -457,10 +691,11 @@ void main(void)
         {
             printf("\nSaving Firmware and Configuration Record to flash\n");
 
-            status = twSaveFwrcfgToFlash(fd, &imageNum);
+            status = twSaveFwrcfgToFlash(pDev, &imageNum);
             if (status != HBI_STATUS_SUCCESS)
             {
                 printf("Error %d:HBI_set_command(HBI_CMD_SAVE_FWRCFG_TO_FLASH)\n", status);
+                exitCode = -1;
             }
             else
             {
@@ -469,19 +704,21 @@ void main(void)
         }
         printf("\nStart Firmware\n");
 
-        status = twStartFwrFromRam(fd);
+        status = twStartFwrFromRam(pDev);
         if (status != HBI_STATUS_SUCCESS)
         {
             printf("Error %d:HBI_set_command(HBI_CMD_START_FWR)\n", status);
+            exitCode = -1;
         }
 
     }
     fwrLoaded = 0;
     cfgrecLoaded = 0;
     printf("Closing device file....\n");
-    HbiPortClose(fd);
-    return;
+    HbiPortClose(pDev);
+    return exitCode;
 }
+#endif /* TW_LOADER_NO_MAIN */
 
 
 /** \} */
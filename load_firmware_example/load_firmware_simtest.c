@@ -0,0 +1,155 @@
+/*******************************************************************************
+* Copyright (C) 2021 Microchip Technology Inc. and its subsidiaries.
+*
+* Subject to your compliance with these terms, you may use Microchip software
+* and any derivatives exclusively with Microchip products. It is your
+* responsibility to comply with third party license terms applicable to your
+* use of third party software (including open source software) that may
+* accompany Microchip software.
+*
+* THIS SOFTWARE IS SUPPLIED BY MICROCHIP "AS IS". NO WARRANTIES, WHETHER
+* EXPRESS, IMPLIED OR STATUTORY, APPLY TO THIS SOFTWARE, INCLUDING ANY IMPLIED
+* WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY, AND FITNESS FOR A
+* PARTICULAR PURPOSE.
+*
+* IN NO EVENT WILL MICROCHIP BE LIABLE FOR ANY INDIRECT, SPECIAL, PUNITIVE,
+* INCIDENTAL OR CONSEQUENTIAL LOSS, DAMAGE, COST OR EXPENSE OF ANY KIND
+* WHATSOEVER RELATED TO THE SOFTWARE, HOWEVER CAUSED, EVEN IF MICROCHIP HAS
+* BEEN ADVISED OF THE POSSIBILITY OR THE DAMAGES ARE FORESEEABLE. TO THE
+* FULLEST EXTENT ALLOWED BY LAW, MICROCHIP'S TOTAL LIABILITY ON ALL CLAIMS IN
+* ANY WAY RELATED TO THIS SOFTWARE WILL NOT EXCEED THE AMOUNT OF FEES, IF ANY,
+* THAT YOU HAVE PAID DIRECTLY TO MICROCHIP FOR THIS SOFTWARE.
+*******************************************************************************/
+
+/* Firmware loader test against the simulator. A firmware image laid out the
+ * way twConvertFirmware2c writes it is loaded with vprocLoadImage() into a
+ * simulated device that takes a while to come out of reset, once without a
+ * failure and once with a failed block group, which makes the loader reset
+ * the device and load the image again. The device RAM is compared with the
+ * image afterwards. Exits with 0 if every case passed.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hbi.h"
+
+#define SIMTEST_RESET_LATENCY_US     2000
+#define SIMTEST_IMAGE_ADDR           0x00020000
+#define SIMTEST_BLOCK_DATA           128
+#define SIMTEST_BLOCK_BYTES          (2 + 2 + 4 + 2 + SIMTEST_BLOCK_DATA)
+#define SIMTEST_NUM_BLOCKS           200
+#define SIMTEST_HDR_BYTES            12
+
+HbiStatus vprocLoadImage(HbiDevice *pDev, const unsigned char *loadPtr);
+
+/* build a firmware image: the header, then blocks each writing the page
+   255 window base address and one paged write of data at its offset. Page 255 is selected once,
+   by the first block, as in a converted image */
+static uint8_t *SimTestImage(void)
+{
+    uint32_t len = SIMTEST_NUM_BLOCKS * SIMTEST_BLOCK_BYTES;
+    uint32_t b, i, addr;
+    uint8_t *pImg, *p;
+
+    pImg = malloc(SIMTEST_HDR_BYTES + len);
+    if (pImg == NULL)
+    {
+        return NULL;
+    }
+    memset(pImg, 0xFF, SIMTEST_HDR_BYTES + len);
+    pImg[0] = 0;
+    pImg[1] = 0;    /* firmware image */
+    pImg[4] = (SIMTEST_BLOCK_BYTES / 2) >> 8;
+    pImg[5] = (SIMTEST_BLOCK_BYTES / 2) & 0xFF;
+    pImg[6] = len >> 24;
+    pImg[7] = (len >> 16) & 0xFF;
+    pImg[8] = (len >> 8) & 0xFF;
+    pImg[9] = len & 0xFF;
+
+    for (b = 0; b < SIMTEST_NUM_BLOCKS; b++)
+    {
+        p = &pImg[SIMTEST_HDR_BYTES + b * SIMTEST_BLOCK_BYTES];
+        addr = SIMTEST_IMAGE_ADDR + b * SIMTEST_BLOCK_DATA;
+        if (b == 0)
+        {
+            *p++ = 0xFE;
+            *p++ = 0xFF;
+        }
+        *p++ = 0x80 | (0x000C >> 1);
+        *p++ = 0x80 | 1;
+        *p++ = addr >> 24;
+        *p++ = (addr >> 16) & 0xFF;
+        *p++ = (addr >> 8) & 0xFF;
+        *p++ = 0x00;
+        *p++ = (addr & 0xFF) >> 1;
+        *p++ = 0x80 | ((SIMTEST_BLOCK_DATA >> 1) - 1);
+        for (i = 0; i < SIMTEST_BLOCK_DATA; i++)
+        {
+            *p++ = (uint8_t)(addr + i * 7);
+        }
+    }
+    return pImg;
+}
+
+/* load the image with the given batch failing, 0 for none, and check the
+   device RAM afterwards */
+static bool SimTestLoad(uint8_t const *pImg, uint32_t failBatch)
+{
+    HbiDeviceCfg cfg = { 0 };
+    HbiSimCfg simCfg = { 0 };
+    HbiDevice *pDev;
+    HbiStatus status;
+    uint8_t check[SIMTEST_BLOCK_DATA];
+    uint32_t b, i, addr;
+    bool ok;
+
+    cfg.path = "sim";
+    if (!HbiPortOpen(&pDev, &cfg))
+    {
+        printf("HbiPortOpen ERROR\n");
+        return false;
+    }
+    simCfg.cmdLatencyUs = SIMTEST_RESET_LATENCY_US;
+    simCfg.failBatch = failBatch;
+    HbiSimConfigure(pDev, &simCfg);
+
+    HbiTransactionBegin(pDev);
+    status = vprocLoadImage(pDev, pImg);
+    HbiTransactionEnd(pDev);
+    ok = (status == HBI_STATUS_SUCCESS);
+
+    for (b = 0; ok && (b < SIMTEST_NUM_BLOCKS); b++)
+    {
+        addr = SIMTEST_IMAGE_ADDR + b * SIMTEST_BLOCK_DATA;
+        ok = (HbiSimReadMem(pDev, addr, check, sizeof(check)) == HBI_STATUS_SUCCESS);
+        for (i = 0; ok && (i < SIMTEST_BLOCK_DATA); i++)
+        {
+            ok = (check[i] == (uint8_t)(addr + i * 7));
+        }
+    }
+    HbiPortClose(pDev);
+
+    printf("%-30s %s\n", failBatch ? "load, block group fails" : "load", ok ? "PASS" : "FAIL");
+    return ok;
+}
+
+int main(void)
+{
+    uint8_t *pImg;
+    bool ok;
+
+    pImg = SimTestImage();
+    if (pImg == NULL)
+    {
+        printf("Error: out of memory\n");
+        return -1;
+    }
+    ok = SimTestLoad(pImg, 0);
+    /* the first group, after the page select, and a later one */
+    ok = SimTestLoad(pImg, 1) && ok;
+    ok = SimTestLoad(pImg, 3) && ok;
+    free(pImg);
+    return ok ? 0 : -1;
+}
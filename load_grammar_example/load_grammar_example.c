@@ -37,13 +37,12 @@ extern const unsigned char grammar[];
 extern const unsigned int grammar_size;
 
 /* ------------------------------------------------------------ */
-void BusySpinWait(int32_t fd)
+void BusySpinWait(HbiDevice *pDev)
 {
-    uint16_t buf = 0xFFFF;
-    while (buf == 0xFFFF)
-    {
-        HbiRead(fd, 0x032, (uint8_t *)&buf, 2);
-    }
+    /* wait for the command register to leave 0xFFFF, sleeping between polls */
+    HbiPollReg(pDev, 0x032, 0xFFFF, 0xFFFF, false, NULL, NULL);
+    /* the command may have changed registers held in the driver's shadow */
+    HbiInvalidateCache(pDev);
 }
 unsigned int Buffer2Int(unsigned char  *pData)
 {
@@ -66,32 +65,32 @@ void Int2Buffer(unsigned int integer, unsigned char *pData)
     pData[3] = (unsigned char)((integer >> 8) & 0x000000FF);
 }
 
-void LoadGrammarFile(int32_t fd, unsigned char * grammarPtr)
+void LoadGrammarFile(HbiDevice *pDev, unsigned char * grammarPtr)
 {
     size_t byteCount;
-    unsigned char  buf[MAX_RW_SIZE];
+    unsigned char  *buf;
     HbiStatus status;
     unsigned char offset, segAddress[4], segAddressTemp[4], segSize[4], AddWr[4];
     unsigned short lastSegIndex;
     unsigned int maxSize;
     int i;
     unsigned int len = 0;
-    uint16_t val;
-
-    /* Read the ASR segment address */
-    HbiRead(fd, 0x4B8, segAddress, 4);
+    uint16_t val, val2;
+    HbiBatch batch;
+
+    /* Read the ASR segment address and the ASR max address */
+    HbiBatchBegin(pDev, &batch);
+    HbiBatchAppendRead(&batch, 0x4B8, segAddress, 4);
+    HbiBatchAppendRead(&batch, 0x4BC, segAddressTemp, 4);
+    HbiBatchSubmit(&batch);
     offset = segAddress[2];
 
-
-    /* Read the ASR max address */
-    HbiRead(fd, 0x4BC, segAddressTemp, 4);
-
     /* Get the grammar max size */
     maxSize = Buffer2Int(segAddressTemp) - Buffer2Int(segAddress) - 1;
 
     if (grammar_size > maxSize) {
         printf("Error - LoadGrammarFile(): Grammar file to large (exceeds %d bytes)\n", maxSize);
-        HbiPortClose(fd);
+        HbiPortClose(pDev);
         exit(-1);
     }
 
@@ -100,10 +99,19 @@ void LoadGrammarFile(int32_t fd, unsigned char * grammarPtr)
 
     /* Disable the ASR */
     val = 0x800D;
-    HbiWrite(fd, 0x032, (uint8_t *)&val, 2);
-    val = 4;
-    HbiWrite(fd, 0x006, (uint8_t *)&val, 2);
-    BusySpinWait(fd);
+    val2 = 4;
+    HbiBatchAppendWrite(&batch, 0x032, (uint8_t *)&val, 2);
+    HbiBatchAppendWrite(&batch, 0x006, (uint8_t *)&val2, 2);
+    HbiBatchSubmit(&batch);
+    BusySpinWait(pDev);
+
+    /* one pool buffer serves every chunk of the file */
+    buf = HbiBufGet(pDev, MAX_RW_SIZE);
+    if (buf == NULL) {
+        printf("Error - LoadGrammarFile(): no transfer buffer available\n");
+        HbiPortClose(pDev);
+        exit(-1);
+    }
 
     byteCount = MAX_RW_SIZE;
     while (len < grammar_size)
@@ -124,12 +132,10 @@ void LoadGrammarFile(int32_t fd, unsigned char * grammarPtr)
         /* Store the start address for later use */
         memcpy(AddWr, segAddress, 4);
 
-        /* Write the address for a page 255 type access */
-        HbiWrite(fd, 0x00C, AddWr, 4);
-
-
-        /* Write the block */
-        HbiWrite(fd, 0xFF00 | (uint16_t)offset, buf, byteCount);
+        /* Write the address for a page 255 type access and the block */
+        HbiBatchAppendWrite(&batch, 0x00C, AddWr, 4);
+        HbiBatchAppendWrite(&batch, 0xFF00 | (uint16_t)offset, buf, byteCount);
+        HbiBatchSubmit(&batch);
 
 
         Int2Buffer(Buffer2Int(segAddress) + byteCount, segAddress);
@@ -137,17 +143,18 @@ void LoadGrammarFile(int32_t fd, unsigned char * grammarPtr)
         offset = segAddress[2];
 
     }
+    HbiBufPut(pDev, buf);
 
     /* Update the segment table */
     /* Recover the start address */
     memcpy(segAddress, segAddressTemp, 4);
 
-    HbiRead(fd, 0x13E, (uint8_t *)&val, 2);
+    HbiRead(pDev, 0x13E, (uint8_t *)&val, 2);
     /* get the number of segments */
     lastSegIndex = val - 1;
 
     /* Read the load address of the last segment */
-    HbiRead(fd, 0x144 + 8 * lastSegIndex, segAddressTemp, 4);
+    HbiRead(pDev, 0x144 + 8 * lastSegIndex, segAddressTemp, 4);
 
     /* Convert the grammar size in a buffer */
     Int2Buffer(grammar_size, segSize);
@@ -156,24 +163,26 @@ void LoadGrammarFile(int32_t fd, unsigned char * grammarPtr)
     if (Buffer2Int(segAddressTemp) == Buffer2Int(segAddress))
     {
         /* Update the last segment size */
-        HbiWrite(fd, 0x140 + 8 * lastSegIndex, segSize, 4);
+        HbiBatchAppendWrite(&batch, 0x140 + 8 * lastSegIndex, segSize, 4);
     }
     else
     {
         /* Create a new segment */
         lastSegIndex++;
-        HbiWrite(fd, 0x140 + 8 * lastSegIndex, segSize, 4);
-        HbiWrite(fd, 0x144 + 8 * lastSegIndex, segAddress, 4);
         val = lastSegIndex + 1;
-        HbiWrite(fd, 0x13E, (uint8_t *)&val, 2);
+        HbiBatchAppendWrite(&batch, 0x140 + 8 * lastSegIndex, segSize, 4);
+        HbiBatchAppendWrite(&batch, 0x144 + 8 * lastSegIndex, segAddress, 4);
+        HbiBatchAppendWrite(&batch, 0x13E, (uint8_t *)&val, 2);
     }
 
-    /* Enable the ASR */
-    val = 0x800E;
-    HbiWrite(fd, 0x032, (uint8_t *)&val, 2);
-    val = 4;
-    HbiWrite(fd, 0x006, (uint8_t *)&val, 2);
-    BusySpinWait(fd);
+    /* Enable the ASR, sent together with the segment table update */
+    val2 = 0x800E;
+    HbiBatchAppendWrite(&batch, 0x032, (uint8_t *)&val2, 2);
+    val2 = 4;
+    HbiBatchAppendWrite(&batch, 0x006, (uint8_t *)&val2, 2);
+    HbiBatchSubmit(&batch);
+    HbiBatchEnd(&batch);
+    BusySpinWait(pDev);
 
     printf("Info - Grammar successfully loaded to RAM\n");
 }
@@ -184,23 +193,23 @@ int main(int argc, char** argv)
     int c, ret, numGrammars, queryNumGrammar = 0, saveToFlash = 0, grammarIdx = -1;
     char *binGrammarPath = NULL;
     HbiStatus  status;
-    int fd;
+    HbiDevice *pDev;
     uint16_t     val;
     const unsigned char * grammarPtr = &grammar[0];
 
-    ret = HbiPortOpen(&fd);
+    ret = HbiPortOpen(&pDev, NULL);
     /* The firmware needs to be running in order to manage grammars */
 
-    HbiRead(fd, 0x028, (uint8_t *)&val, 2);
+    HbiRead(pDev, 0x028, (uint8_t *)&val, 2);
     if ((val & 0x8000) == 0) {
         printf("Error - Main(): Application firmware stopped\n");
-        HbiPortClose(fd);
+        HbiPortClose(pDev);
         exit(-1);
     }
 
-    LoadGrammarFile(fd, grammarPtr);
+    LoadGrammarFile(pDev, grammarPtr);
 
     /* Close the HBI driver */
-    HbiPortClose(fd);
+    HbiPortClose(pDev);
     return 0;
 }
\ No newline at end of file
@@ -25,21 +25,24 @@
 #include <stdio.h>
 #include "hbi.h"
 
-int fd;
-static inline HbiStatus HbiResetToBoot(int32_t fd)
+HbiDevice *pDev;
+static inline HbiStatus HbiResetToBoot(HbiDevice *pDev)
 {
     HbiStatus status = HBI_STATUS_SUCCESS;
     uint16_t     val = 0;
+    /* sleep 0.1 ms doubling up to 5 ms between polls, give up after 50 ms */
+    const HbiPollCfg resetPollCfg = { 0, 100, 5000, 50 };
 
     val = 1;
-    status = HbiWrite(fd, 0x014, (uint8_t *)&val, 2); /*go to boot rom mode*/
+    status = HbiWrite(pDev, 0x014, (uint8_t *)&val, 2); /*go to boot rom mode*/
 
-    /*required for the reset to cmplete. */
-    HbiPortDelay(50);
+    /*device state cached by the driver does not survive the reset*/
+    HbiInvalidateCache(pDev);
 
-    /*check whether the device has gone into boot mode as ordered*/
-    status = HbiRead(fd, 0x0034, (uint8_t *)&val, 2);
-    if (status != HBI_STATUS_SUCCESS)
+    /*check whether the device has gone into boot mode as ordered, it
+      takes up to 50 ms for the reset to complete */
+    status = HbiPollReg(pDev, 0x0034, 0xFFFF, 0xD3D3, true, &resetPollCfg, &val);
+    if ((status != HBI_STATUS_SUCCESS) && (status != HBI_STATUS_OP_INCOMPLETE))
     {
         printf("HBI Read Failed \n");
         return HBI_STATUS_INTERNAL_ERR;
@@ -53,7 +56,7 @@ static inline HbiStatus HbiResetToBoot(int32_t fd)
     return status;
 
 }
-HbiStatus HbiEraseFlash(int32_t fd)
+HbiStatus HbiEraseFlash(HbiDevice *pDev)
 {
     HbiStatus            status = HBI_STATUS_SUCCESS;
     uint16_t                val = 0;
@@ -61,7 +64,7 @@ HbiStatus HbiEraseFlash(int32_t fd)
     ZL380xx_HMI_RESPONSE    hmi_response;
 
     /* read the app running status bit from reg 0x28 "Currently Loaded Firmware Reg" */
-    status = HbiRead(fd, 0x0028, (uint8_t *)&val, sizeof(val));
+    status = HbiRead(pDev, 0x0028, (uint8_t *)&val, sizeof(val));
     if (val & ZL380xx_CUR_FW_APP_RUNNING)
     {
         boot_stat = 0;
@@ -69,17 +72,17 @@ HbiStatus HbiEraseFlash(int32_t fd)
     if (!boot_stat)
     {
         /* put device in boot rom mode */
-        status = HbiResetToBoot(fd);
+        status = HbiResetToBoot(pDev);
         CHK_STATUS(status);
     }
 
     /* if there is a flash on board initialize it HOST_CMD_HOST_FLASH_INIT */
-    status = HbiWriteHostCmd(fd, HOST_CMD_HOST_FLASH_INIT);
+    status = HbiWriteHostCmd(pDev, HOST_CMD_HOST_FLASH_INIT);
     CHK_STATUS(status);
 
     /*Checks the status register to know result of command issued    */
     /*0x0034 Host Command Param/Result register*/
-    status = HbiRead(fd, 0x0034, (uint8_t  *)&val, sizeof(val));
+    status = HbiRead(pDev, 0x0034, (uint8_t  *)&val, sizeof(val));
     hmi_response = (int32_t)val;
     switch (hmi_response)
     {
@@ -93,16 +96,16 @@ HbiStatus HbiEraseFlash(int32_t fd)
     }
     /* erase all config/fwr */
     val = 0xAA55;
-    status = HbiWrite(fd, 0x0034, (uint8_t *)&val, sizeof(val));
+    status = HbiWrite(pDev, 0x0034, (uint8_t *)&val, sizeof(val));
     CHK_STATUS(status);
 
     /* erase firmware */
-    status = HbiWriteHostCmd(fd, HOST_CMD_ERASE_FLASH_INIT);
+    status = HbiWriteHostCmd(pDev, HOST_CMD_ERASE_FLASH_INIT);
     CHK_STATUS(status);
 
     /*Checks the status register to know result of command issued    */
     /*0x0034 Host Command Param/Result register*/
-    status = HbiRead(fd, 0x0034, (uint8_t  *)&val, sizeof(val));
+    status = HbiRead(pDev, 0x0034, (uint8_t  *)&val, sizeof(val));
     hmi_response = (int32_t)val;
     switch (hmi_response)
     {
@@ -120,14 +123,20 @@ HbiStatus HbiEraseFlash(int32_t fd)
     }
 
 }
-int main()
+int main(int argc, char** argv)
 {
     uint8_t rBuf[2] = { 0 };
     uint8_t wBuf[2] = { 0 };
     int ret;
     HbiStatus status;
+    HbiDeviceCfg cfg = { 0 };
 
-    ret = HbiPortOpen(&fd);
+    /* optional bus device node, /dev/i2c-* selects the I2C transport */
+    if (argc > 1)
+    {
+        cfg.path = argv[1];
+    }
+    ret = HbiPortOpen(&pDev, &cfg);
     if (ret == 0)
     {
         printf("HbiPortOpen ERROR\n");
@@ -137,11 +146,11 @@ int main()
     /*    Example for write register 0x000E      */
     /********************************************/
     wBuf[1] = 0xAB; wBuf[0] = 0xCD;
-    status = HbiWrite(fd, 0x000E, &wBuf[0], 2);
+    status = HbiWrite(pDev, 0x000E, &wBuf[0], 2);
     if (status != HBI_STATUS_SUCCESS)
     {
         printf("HBI write failed\n");
-        HbiPortClose(fd);
+        HbiPortClose(pDev);
         return -1;
     }
 
@@ -149,11 +158,11 @@ int main()
     /*    Example for read register 0x000E      */
     /********************************************/
 
-    status = HbiRead(fd, 0x000E, &rBuf[0], 2);
+    status = HbiRead(pDev, 0x000E, &rBuf[0], 2);
     if (status != HBI_STATUS_SUCCESS)
     {
         printf("HBI read failed\n");
-        HbiPortClose(fd);
+        HbiPortClose(pDev);
         return -1;
     }
 
@@ -164,7 +173,11 @@ int main()
     /* This example shows how to do "ERASE FLASH"                                                */
     /*********************************************************************************************/
 
-    status = HbiEraseFlash(fd);
+    /* reset, flash init and erase run as one transaction, no other thread
+       can issue a host command in between and overwrite the results */
+    HbiTransactionBegin(pDev);
+    status = HbiEraseFlash(pDev);
+    HbiTransactionEnd(pDev);
     if (status == HBI_STATUS_SUCCESS)
     {
         printf("flash erasing completed successfully...\n");
@@ -172,10 +185,10 @@ int main()
     else
     {
         printf("Error %d:HbiEraseFlash\n", status);
-        HbiPortClose(fd);
+        HbiPortClose(pDev);
         return -1;
     }
-    HbiPortClose(fd);
+    HbiPortClose(pDev);
 
     return 0;
-}
\ No newline at end of file
+}
\ No newline at end of file
@@ -0,0 +1,524 @@
+/*******************************************************************************
+* Copyright (C) 2021 Microchip Technology Inc. and its subsidiaries.
+*
+* Subject to your compliance with these terms, you may use Microchip software
+* and any derivatives exclusively with Microchip products. It is your
+* responsibility to comply with third party license terms applicable to your
+* use of third party software (including open source software) that may
+* accompany Microchip software.
+*
+* THIS SOFTWARE IS SUPPLIED BY MICROCHIP "AS IS". NO WARRANTIES, WHETHER
+* EXPRESS, IMPLIED OR STATUTORY, APPLY TO THIS SOFTWARE, INCLUDING ANY IMPLIED
+* WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY, AND FITNESS FOR A
+* PARTICULAR PURPOSE.
+*
+* IN NO EVENT WILL MICROCHIP BE LIABLE FOR ANY INDIRECT, SPECIAL, PUNITIVE,
+* INCIDENTAL OR CONSEQUENTIAL LOSS, DAMAGE, COST OR EXPENSE OF ANY KIND
+* WHATSOEVER RELATED TO THE SOFTWARE, HOWEVER CAUSED, EVEN IF MICROCHIP HAS
+* BEEN ADVISED OF THE POSSIBILITY OR THE DAMAGES ARE FORESEEABLE. TO THE
+* FULLEST EXTENT ALLOWED BY LAW, MICROCHIP'S TOTAL LIABILITY ON ALL CLAIMS IN
+* ANY WAY RELATED TO THIS SOFTWARE WILL NOT EXCEED THE AMOUNT OF FEES, IF ANY,
+* THAT YOU HAVE PAID DIRECTLY TO MICROCHIP FOR THIS SOFTWARE.
+*******************************************************************************/
+
+/* Replays the frames of a capture file (see HbiCaptureStart(), e.g. taken
+ * with HBI_CAPTURE=load.cap hbi_load_firmware ...) against a device, the
+ * simulator or a frame sink that discards everything, and reports the
+ * throughput and transaction latency achieved.
+ *
+ * Modes:
+ *   timed  every transaction is started at its original time offset
+ *   fast   transactions as captured, back to back
+ *   batch  consecutive frames merged into batches as large as the driver allows
+ *
+ * The captured bytes are sent as they are, read data is not compared, so a
+ * replay against a device only reproduces the bus traffic, not its effect.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <unistd.h>
+#include "hbi.h"
+
+typedef enum
+{
+    REPLAY_TIMED,
+    REPLAY_FAST,
+    REPLAY_BATCH
+} ReplayMode;
+
+typedef struct
+{
+    HbiCaptureRec  rec;
+    uint8_t       *tx;
+} ReplayFrame;
+
+/* gaps shorter than this are waited for by spinning in timed mode */
+#define REPLAY_SPIN_NS               200000
+
+/* read data of a bus transaction, a batch or the largest single frame */
+static uint8_t *rxBuf;
+
+/* frame sink, accepts everything and reads zeros */
+static bool SinkOpen(HbiDevice *pDev)
+{
+    (void)pDev;
+    return true;
+}
+
+static void SinkClose(HbiDevice *pDev)
+{
+    (void)pDev;
+}
+
+static bool SinkRead(HbiDevice *pDev, void *pSrc, void *pDst, size_t nread, size_t nwrite)
+{
+    (void)pDev;
+    (void)pSrc;
+    (void)nwrite;
+    memset(pDst, 0, nread);
+    return true;
+}
+
+static bool SinkWrite(HbiDevice *pDev, uint8_t const *tx, uint8_t const *rx, size_t len)
+{
+    (void)pDev;
+    (void)tx;
+    (void)rx;
+    (void)len;
+    return true;
+}
+
+static bool SinkBatch(HbiDevice *pDev, HbiBatch *pBatch)
+{
+    int32_t i;
+
+    (void)pDev;
+    for (i = 0; i < pBatch->numFrames; i++)
+    {
+        if (pBatch->frame[i].rxLen)
+        {
+            memset(pBatch->frame[i].rx, 0, pBatch->frame[i].rxLen);
+        }
+    }
+    return true;
+}
+
+static const HbiTransport sinkTransport =
+{
+    "sink",
+    SinkOpen,
+    SinkClose,
+    SinkRead,
+    SinkWrite,
+    NULL,
+    SinkBatch,
+    NULL,
+    NULL
+};
+
+static uint64_t NowNs(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+/* wait until CLOCK_MONOTONIC time ns. The last stretch is spun, a sleep
+   overshoots by far more than the gaps between captured transactions */
+static void SleepUntilNs(uint64_t ns)
+{
+    struct timespec wake;
+    uint64_t spinFrom = ns - REPLAY_SPIN_NS;
+
+    if (NowNs() < spinFrom)
+    {
+        wake.tv_sec = spinFrom / 1000000000;
+        wake.tv_nsec = spinFrom % 1000000000;
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake, NULL) == EINTR)
+        {
+        }
+    }
+    while (NowNs() < ns)
+    {
+    }
+}
+
+static int CompareU64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+/* read a capture file into pFrames, returns the number of frames or -1 */
+static int32_t LoadCapture(const char *path, ReplayFrame **ppFrames, uint8_t **ppData)
+{
+    HbiCaptureFileHdr hdr;
+    ReplayFrame *pFrames = NULL;
+    uint8_t *pData = NULL;
+    FILE *fp;
+    long size;
+    size_t used = 0;
+    int32_t num = 0, max = 0;
+    void *p;
+
+    fp = fopen(path, "rb");
+    if (fp == NULL)
+    {
+        printf("Error: can't open %s\n", path);
+        return -1;
+    }
+    fseek(fp, 0, SEEK_END);
+    size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+
+    if ((fread(&hdr, sizeof(hdr), 1, fp) != 1) ||
+        memcmp(hdr.magic, HBI_CAPTURE_MAGIC, sizeof(hdr.magic)) ||
+        (hdr.version != HBI_CAPTURE_VERSION) || (hdr.recSize != sizeof(HbiCaptureRec)))
+    {
+        printf("Error: %s is not a capture file or has an unsupported version\n", path);
+        fclose(fp);
+        return -1;
+    }
+
+    /* the frame bytes are never more than the file */
+    pData = malloc(size);
+    if (pData == NULL)
+    {
+        fclose(fp);
+        return -1;
+    }
+
+    for (;;)
+    {
+        if (num == max)
+        {
+            max = max ? (max * 2) : 1024;
+            p = realloc(pFrames, max * sizeof(ReplayFrame));
+            if (p == NULL)
+            {
+                num = -1;
+                break;
+            }
+            pFrames = p;
+        }
+        if (fread(&pFrames[num].rec, sizeof(HbiCaptureRec), 1, fp) != 1)
+        {
+            break;
+        }
+        if ((pFrames[num].rec.txLen == 0) ||
+            (fread(&pData[used], pFrames[num].rec.txLen, 1, fp) != 1))
+        {
+            printf("Error: capture file truncated\n");
+            break;
+        }
+        /* raw streams are replayed as plain writes */
+        if (pFrames[num].rec.flags & HBI_TRACE_F_RAW)
+        {
+            pFrames[num].rec.rxLen = 0;
+        }
+        /* offset for now, pData is stable once everything is read */
+        pFrames[num].tx = (uint8_t *)(uintptr_t)used;
+        used += pFrames[num].rec.txLen;
+        num++;
+    }
+    fclose(fp);
+
+    if (num < 0)
+    {
+        free(pFrames);
+        free(pData);
+        return -1;
+    }
+    for (max = 0; max < num; max++)
+    {
+        pFrames[max].tx = pData + (uintptr_t)pFrames[max].tx;
+    }
+    *ppFrames = pFrames;
+    *ppData = pData;
+    return num;
+}
+
+/* bytes frame counts against the bus limit of a batch */
+static size_t FrameBytes(HbiBatch *pBatch, ReplayFrame const *pFrame)
+{
+    return HbiBatchFrameBytes(pBatch->pDev, pFrame->rec.txLen, pFrame->rec.rxLen);
+}
+
+/* true if frame fits in pBatch */
+static bool BatchFits(HbiBatch *pBatch, ReplayFrame const *pFrame)
+{
+    return (pBatch->numFrames < pBatch->maxFrames) &&
+        ((pBatch->msgUsed + FrameBytes(pBatch, pFrame)) <= pBatch->maxBytes);
+}
+
+static void BatchAdd(HbiBatch *pBatch, ReplayFrame const *pFrame)
+{
+    HbiBatchFrame *pBf = &pBatch->frame[pBatch->numFrames];
+
+    pBf->tx = &pBatch->buf[pBatch->txUsed];
+    pBf->txLen = pFrame->rec.txLen;
+    pBf->rxLen = pFrame->rec.rxLen;
+    pBf->rx = pBf->rxLen ? &rxBuf[pBatch->wireLen - pBatch->txUsed] : NULL;
+    pBf->reg = 0;
+    pBf->size = 0;
+    memcpy(&pBatch->buf[pBatch->txUsed], pFrame->tx, pFrame->rec.txLen);
+    pBatch->txUsed += pFrame->rec.txLen;
+    pBatch->wireLen += pFrame->rec.txLen + pFrame->rec.rxLen;
+    pBatch->msgUsed += FrameBytes(pBatch, pFrame);
+    pBatch->numFrames++;
+}
+
+/* send frames [first, first + num) as one bus transaction */
+static bool SendFrames(HbiDevice *pDev, HbiBatch *pBatch, ReplayFrame const *pFrames, int32_t num)
+{
+    ReplayFrame const *pFrame = pFrames;
+    int32_t i;
+
+    if (num == 1)
+    {
+        if (pFrame->rec.rxLen)
+        {
+            return HbiPortRead(pDev, pFrame->tx, rxBuf, pFrame->rec.rxLen, pFrame->rec.txLen);
+        }
+        return HbiPortWrite(pDev, pFrame->tx, NULL, pFrame->rec.txLen);
+    }
+
+    pBatch->pDev = pDev;
+    pBatch->page = 0;
+    pBatch->raw = false;
+    pBatch->numFrames = 0;
+    pBatch->txUsed = 0;
+    pBatch->wireLen = 0;
+    pBatch->msgUsed = 0;
+    for (i = 0; i < num; i++)
+    {
+        BatchAdd(pBatch, &pFrames[i]);
+    }
+    return HbiPortBatch(pDev, pBatch);
+}
+
+/* number of frames from pFrames on that go into the next bus transaction */
+static int32_t NextGroup(ReplayMode mode, ReplayFrame const *pFrames, int32_t remain,
+    HbiBatch *pBatch)
+{
+    int32_t n = 1;
+
+    /* frames larger than a batch go alone. Outside batch mode the frames of
+       one captured transaction go together, split if it was captured on a
+       bus that carries more than this one */
+    pBatch->numFrames = 0;
+    pBatch->msgUsed = 0;
+    if (!BatchFits(pBatch, &pFrames[0]))
+    {
+        return 1;
+    }
+    pBatch->msgUsed = FrameBytes(pBatch, &pFrames[0]);
+    pBatch->numFrames = 1;
+    while ((n < remain) && BatchFits(pBatch, &pFrames[n]) &&
+        ((mode == REPLAY_BATCH) || (pFrames[n].rec.xfer == pFrames[0].rec.xfer)))
+    {
+        pBatch->msgUsed += FrameBytes(pBatch, &pFrames[n]);
+        pBatch->numFrames++;
+        n++;
+    }
+    return n;
+}
+
+static void PrintLatency(uint64_t *pLat, uint32_t num)
+{
+    uint64_t total = 0;
+    uint32_t i, bucket, count;
+    uint64_t hist[40] = { 0 };
+
+    if (num == 0)
+    {
+        return;
+    }
+    qsort(pLat, num, sizeof(pLat[0]), CompareU64);
+    for (i = 0; i < num; i++)
+    {
+        total += pLat[i];
+        for (bucket = 0; ((pLat[i] >> bucket) > 1) && (bucket < 39); bucket++)
+        {
+        }
+        hist[bucket]++;
+    }
+    printf("transaction latency us: avg %.2f  p50 %.2f  p90 %.2f  p99 %.2f  max %.2f\n",
+        total / 1000.0 / num, pLat[num / 2] / 1000.0, pLat[(uint64_t)num * 9 / 10] / 1000.0,
+        pLat[(uint64_t)num * 99 / 100] / 1000.0, pLat[num - 1] / 1000.0);
+    for (bucket = 0; bucket < 40; bucket++)
+    {
+        count = (uint32_t)hist[bucket];
+        if (count)
+        {
+            printf("  >= %10.3f us %10u\n", (bucket ? (1ull << bucket) : 0) / 1000.0, count);
+        }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    HbiDevice *pDev;
+    HbiDeviceCfg cfg = { 0 };
+    ReplayMode mode = REPLAY_FAST;
+    ReplayFrame *pFrames;
+    HbiBatch *pBatch;
+    HbiStats stats;
+    uint8_t *pData;
+    uint64_t *pLat;
+    uint64_t start, end, t0, runStart, bytes = 0, origNs;
+    uint32_t numLat = 0, repeat = 1, r;
+    size_t rxSize;
+    int32_t num, i, n, failed = 0;
+    bool json = false;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "d:m:n:jh")) != -1)
+    {
+        switch (opt)
+        {
+            case 'd':
+                cfg.path = optarg;
+                break;
+            case 'm':
+                if (strcmp(optarg, "timed") == 0)
+                {
+                    mode = REPLAY_TIMED;
+                }
+                else if (strcmp(optarg, "batch") == 0)
+                {
+                    mode = REPLAY_BATCH;
+                }
+                else if (strcmp(optarg, "fast") == 0)
+                {
+                    mode = REPLAY_FAST;
+                }
+                else
+                {
+                    printf("Error: unknown mode %s\n", optarg);
+                    return -1;
+                }
+                break;
+            case 'n':
+                repeat = (uint32_t)strtoul(optarg, NULL, 0);
+                break;
+            case 'j':
+                json = true;
+                break;
+            default:
+                printf("Usage: %s [-d device|sim] [-m timed|fast|batch] [-n repeat] [-j] <capture file>\n"
+                    "  without -d frames go to a sink that discards them\n", argv[0]);
+                return (opt == 'h') ? 0 : -1;
+        }
+    }
+    if ((optind >= argc) || (repeat == 0))
+    {
+        printf("Usage: %s [-d device|sim] [-m timed|fast|batch] [-n repeat] [-j] <capture file>\n",
+            argv[0]);
+        return -1;
+    }
+
+    num = LoadCapture(argv[optind], &pFrames, &pData);
+    if (num <= 0)
+    {
+        printf("Error: no frames to replay\n");
+        return -1;
+    }
+    pBatch = malloc(sizeof(HbiBatch));
+    pLat = malloc((uint64_t)num * repeat * sizeof(uint64_t));
+    if ((pBatch == NULL) || (pLat == NULL))
+    {
+        printf("Error: out of memory\n");
+        return -1;
+    }
+
+    if (cfg.path == NULL)
+    {
+        cfg.pTransport = &sinkTransport;
+        cfg.path = "sink";
+    }
+    if (!HbiPortOpen(&pDev, &cfg))
+    {
+        printf("HbiPortOpen ERROR\n");
+        return -1;
+    }
+    /* batches are as large as the bus limit of the device replayed to */
+    rxSize = HbiBatchMaxBytes(pDev);
+    for (i = 0; i < num; i++)
+    {
+        if (pFrames[i].rec.rxLen > rxSize)
+        {
+            rxSize = pFrames[i].rec.rxLen;
+        }
+    }
+    rxBuf = malloc(rxSize);
+    if ((rxBuf == NULL) || (HbiBatchBegin(pDev, pBatch) != HBI_STATUS_SUCCESS))
+    {
+        printf("Error: out of memory\n");
+        return -1;
+    }
+
+    runStart = NowNs();
+    t0 = runStart;
+    for (r = 0; r < repeat; r++)
+    {
+        origNs = pFrames[0].rec.startNs;
+        for (i = 0; i < num; i += n)
+        {
+            n = NextGroup(mode, &pFrames[i], num - i, pBatch);
+            if (mode == REPLAY_TIMED)
+            {
+                SleepUntilNs(t0 + (pFrames[i].rec.startNs - origNs));
+            }
+            start = NowNs();
+            if (!SendFrames(pDev, pBatch, &pFrames[i], n))
+            {
+                failed++;
+            }
+            end = NowNs();
+            pLat[numLat++] = end - start;
+            while (n > 0)
+            {
+                bytes += pFrames[i].rec.txLen + pFrames[i].rec.rxLen;
+                i++;
+                n--;
+            }
+        }
+        if (mode == REPLAY_TIMED)
+        {
+            /* the next round starts where this one ended in the original */
+            t0 += pFrames[num - 1].rec.startNs + pFrames[num - 1].rec.durNs - origNs;
+        }
+    }
+    end = NowNs();
+
+    origNs = pFrames[num - 1].rec.startNs + pFrames[num - 1].rec.durNs - pFrames[0].rec.startNs;
+    printf("%d frames x %u, %u transactions, %llu bytes, %d failed\n", num, repeat, numLat,
+        (unsigned long long)bytes, failed);
+    printf("elapsed %.3f ms (captured session %.3f ms), %.3f MB/s, %.0f transactions/s\n",
+        (end - runStart) / 1e6, origNs / 1e6, bytes * 1e3 / (end - runStart + 1),
+        numLat * 1e9 / (end - runStart + 1));
+    PrintLatency(pLat, numLat);
+
+    if (json && (HbiStatsGet(pDev, &stats, false) == HBI_STATUS_SUCCESS))
+    {
+        HbiStatsDumpJson(&stats, stdout);
+    }
+
+    HbiBatchEnd(pBatch);
+    HbiPortClose(pDev);
+    free(rxBuf);
+    free(pLat);
+    free(pBatch);
+    free(pFrames);
+    free(pData);
+    return 0;
+}
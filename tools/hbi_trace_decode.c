@@ -0,0 +1,442 @@
+/*******************************************************************************
+* Copyright (C) 2021 Microchip Technology Inc. and its subsidiaries.
+*
+* Subject to your compliance with these terms, you may use Microchip software
+* and any derivatives exclusively with Microchip products. It is your
+* responsibility to comply with third party license terms applicable to your
+* use of third party software (including open source software) that may
+* accompany Microchip software.
+*
+* THIS SOFTWARE IS SUPPLIED BY MICROCHIP "AS IS". NO WARRANTIES, WHETHER
+* EXPRESS, IMPLIED OR STATUTORY, APPLY TO THIS SOFTWARE, INCLUDING ANY IMPLIED
+* WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY, AND FITNESS FOR A
+* PARTICULAR PURPOSE.
+*
+* IN NO EVENT WILL MICROCHIP BE LIABLE FOR ANY INDIRECT, SPECIAL, PUNITIVE,
+* INCIDENTAL OR CONSEQUENTIAL LOSS, DAMAGE, COST OR EXPENSE OF ANY KIND
+* WHATSOEVER RELATED TO THE SOFTWARE, HOWEVER CAUSED, EVEN IF MICROCHIP HAS
+* BEEN ADVISED OF THE POSSIBILITY OR THE DAMAGES ARE FORESEEABLE. TO THE
+* FULLEST EXTENT ALLOWED BY LAW, MICROCHIP'S TOTAL LIABILITY ON ALL CLAIMS IN
+* ANY WAY RELATED TO THIS SOFTWARE WILL NOT EXCEED THE AMOUNT OF FEES, IF ANY,
+* THAT YOU HAVE PAID DIRECTLY TO MICROCHIP FOR THIS SOFTWARE.
+*******************************************************************************/
+
+/********************************************/
+/*! \mainpage
+*
+* \section intro_sec Introduction
+*
+* This tool decodes a frame trace written by HbiTraceFlush() into HBI
+* operations: page selects, register and memory reads and writes, host
+* commands with their completion time, and a per operation timing summary.
+*
+* \section BI Build Instructions
+*
+* Example Make Command:
+*
+* gcc -I../hbi hbi_trace_decode.c -o hbi_trace_decode
+*
+* Usage:
+*
+* hbi_trace_decode <options> <trace file>
+*
+* Options:
+*
+* -q  summary only, don't list the operations
+*
+* To Display help menu
+*
+* hbi_trace_decode -h
+*
+********************************************************************************/
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "hbi.h"
+
+#define HBI_TRACE_MAX_SHOW_WORDS     8
+
+/* operation kinds summarised at the end */
+typedef enum
+{
+    OP_PAGE,
+    OP_REG_READ,
+    OP_REG_WRITE,
+    OP_MEM_READ,
+    OP_MEM_WRITE,
+    OP_HOST_CMD,
+    OP_OTHER,
+    OP_NUM
+} TraceOp;
+
+static const char *opName[OP_NUM] =
+{
+    "page select", "register read", "register write", "memory read",
+    "memory write", "host command", "other"
+};
+
+typedef struct
+{
+    uint64_t count;
+    uint64_t bytes;
+    uint64_t totalNs;
+    uint64_t maxNs;
+} OpSummary;
+
+/* decoder state carried from frame to frame */
+typedef struct
+{
+    int32_t  page;          /* selected page, -1 if not known */
+    uint32_t memBase;       /* page 255 base address from register 0x000C */
+    uint16_t contReg;       /* register a continuous write continues at */
+    uint16_t hostCmd;       /* last value written to 0x0032 */
+    uint64_t cmdStartNs;    /* issue time of the host command in progress */
+    bool     cmdPending;
+    uint64_t firstNs;
+    bool     quiet;
+    OpSummary sum[OP_NUM];
+    uint64_t frames;
+    uint64_t dropped;
+    uint64_t errors;
+    uint64_t truncated;
+} TraceState;
+
+static uint16_t GetWord(uint8_t const *p)
+{
+    return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+static void Account(TraceState *pState, TraceOp op, size_t bytes, uint32_t durNs)
+{
+    OpSummary *pSum = &pState->sum[op];
+
+    pSum->count++;
+    pSum->bytes += bytes;
+    pSum->totalNs += durNs;
+    if (durNs > pSum->maxNs)
+    {
+        pSum->maxNs = durNs;
+    }
+}
+
+/* print up to HBI_TRACE_MAX_SHOW_WORDS of the nAvail captured bytes of a
+   payload of size bytes */
+static void PrintWords(uint8_t const *p, size_t nAvail, size_t size)
+{
+    size_t i;
+
+    for (i = 0; (i + 1 < nAvail) && (i < size) && (i < (HBI_TRACE_MAX_SHOW_WORDS * 2)); i += 2)
+    {
+        printf(" %04X", GetWord(&p[i]));
+    }
+    if (i < size)
+    {
+        printf(" ...");
+    }
+}
+
+/* the register or memory access of one command word and its payload */
+static void DecodeAccess(TraceState *pState, HbiTraceRec const *pRec, uint16_t reg,
+    bool write, size_t size, uint8_t const *payload, size_t nAvail)
+{
+    bool mem = ((reg >> 8) == 0xFF);
+    uint32_t addr = (pState->memBase & ~0xFFu) + (reg & 0xFF);
+    TraceOp op = mem ? (write ? OP_MEM_WRITE : OP_MEM_READ) : (write ? OP_REG_WRITE : OP_REG_READ);
+
+    Account(pState, op, size, pRec->durNs);
+    if (!pState->quiet)
+    {
+        if (mem)
+        {
+            printf("  %s mem 0x%08X [%u]:", write ? "WR" : "RD", addr, (uint32_t)size);
+        }
+        else
+        {
+            printf("  %s 0x%04X [%u]:", write ? "WR" : "RD", reg, (uint32_t)size);
+        }
+        PrintWords(payload, nAvail, size);
+        printf("\n");
+    }
+
+    if (!write || (nAvail < 2))
+    {
+        /* a host command completes when its register reads back idle */
+        if (!write && pState->cmdPending && (reg == 0x0032) && (nAvail >= 2) &&
+            (GetWord(payload) == 0))
+        {
+            Account(pState, OP_HOST_CMD, 0,
+                (uint32_t)(pRec->startNs + pRec->durNs - pState->cmdStartNs));
+            pState->cmdPending = false;
+            if (!pState->quiet)
+            {
+                printf("  host command 0x%04X done after %.1f us\n", pState->hostCmd,
+                    (pRec->startNs + pRec->durNs - pState->cmdStartNs) / 1000.0);
+            }
+        }
+        return;
+    }
+
+    /* writes that change how later frames decode */
+    if (reg == 0x000C)
+    {
+        pState->memBase = (pState->memBase & 0xFFFF) | ((uint32_t)GetWord(payload) << 16);
+        if ((size >= 4) && (nAvail >= 4))
+        {
+            pState->memBase = (pState->memBase & 0xFFFF0000) | GetWord(&payload[2]);
+        }
+    }
+    else if (reg == 0x000E)
+    {
+        pState->memBase = (pState->memBase & 0xFFFF0000) | GetWord(payload);
+    }
+    else if (reg == 0x0032)
+    {
+        pState->hostCmd = GetWord(payload);
+    }
+    else if ((reg == 0x0006) && (GetWord(payload) & 0x1))
+    {
+        pState->cmdPending = true;
+        pState->cmdStartNs = pRec->startNs;
+        if (!pState->quiet)
+        {
+            printf("  host command 0x%04X issued\n", pState->hostCmd);
+        }
+    }
+}
+
+/* walk the command words of one traced frame */
+static void DecodeFrame(TraceState *pState, HbiTraceRec const *pRec)
+{
+    uint8_t const *tx = pRec->data;
+    uint8_t const *rx = &pRec->data[pRec->nTx];
+    size_t p = 0;
+    size_t size, nAvail;
+    uint16_t cmd, reg;
+    uint32_t noops = 0;
+    bool write;
+
+    if (!pState->quiet)
+    {
+        printf("%12.3f us %9.3f us  tx %4u rx %4u%s%s%s\n",
+            (pRec->startNs - pState->firstNs) / 1000.0, pRec->durNs / 1000.0,
+            pRec->txLen, pRec->rxLen,
+            (pRec->flags & HBI_TRACE_F_BATCH) ? " batch" : "",
+            (pRec->flags & HBI_TRACE_F_RAW) ? " raw" : "",
+            (pRec->flags & HBI_TRACE_F_ERROR) ? " ERROR" : "");
+    }
+    if (pRec->flags & HBI_TRACE_F_ERROR)
+    {
+        pState->errors++;
+        pState->page = -1;
+    }
+    if (pRec->nTx < pRec->txLen)
+    {
+        pState->truncated++;
+    }
+
+    while ((p + 1) < pRec->nTx)
+    {
+        cmd = GetWord(&tx[p]);
+        p += 2;
+
+        if (cmd == 0xFFFF)
+        {
+            noops++;
+            continue;
+        }
+        if (noops)
+        {
+            Account(pState, OP_OTHER, 0, 0);
+            if (!pState->quiet)
+            {
+                printf("  NOOP x%u\n", noops);
+            }
+            noops = 0;
+        }
+
+        if ((cmd >> 8) == 0xFE)
+        {
+            pState->page = ((cmd & 0xFF) == 0xFF) ? 0xFF : ((cmd & 0xFF) + 1);
+            Account(pState, OP_PAGE, 0, 0);
+            if (!pState->quiet)
+            {
+                printf("  PAGE %d\n", pState->page);
+            }
+            continue;
+        }
+        if ((cmd >> 8) == 0xFD)
+        {
+            Account(pState, OP_OTHER, 0, 0);
+            if (!pState->quiet)
+            {
+                printf("  CONFIGURE 0x%02X\n", cmd & 0xFF);
+            }
+            continue;
+        }
+
+        if ((cmd >> 8) == 0xFB)
+        {
+            reg = pState->contReg;
+            size = ((cmd & 0xFF) + 1) * 2;
+            write = true;
+        }
+        else
+        {
+            size = ((cmd & 0x7F) + 1) * 2;
+            write = (cmd & 0x80) != 0;
+            reg = (uint16_t)(((cmd >> 8) & 0x7F) << 1);
+            if (!(cmd & 0x8000))
+            {
+                if (pState->page < 0)
+                {
+                    if (!pState->quiet)
+                    {
+                        printf("  paged access 0x%04X on unknown page\n", cmd);
+                    }
+                    Account(pState, OP_OTHER, 0, 0);
+                    if (write)
+                    {
+                        p += size;
+                    }
+                    continue;
+                }
+                reg |= (uint16_t)(pState->page << 8);
+            }
+        }
+
+        if (write)
+        {
+            nAvail = (p < pRec->nTx) ? (pRec->nTx - p) : 0;
+            DecodeAccess(pState, pRec, reg, true, size, &tx[p], nAvail);
+            p += size;
+        }
+        else
+        {
+            DecodeAccess(pState, pRec, reg, false, size, rx, pRec->nRx);
+        }
+        pState->contReg = reg + size;
+    }
+
+    if (noops)
+    {
+        Account(pState, OP_OTHER, 0, 0);
+        if (!pState->quiet)
+        {
+            printf("  NOOP x%u\n", noops);
+        }
+    }
+    if (pRec->nTx < pRec->txLen)
+    {
+        /* the rest of the frame wasn't captured, its commands are unknown */
+        if (pRec->flags & HBI_TRACE_F_RAW)
+        {
+            pState->page = -1;
+        }
+        if (!pState->quiet)
+        {
+            printf("  (%u more bytes not captured)\n", (uint32_t)(pRec->txLen - pRec->nTx));
+        }
+    }
+}
+
+static void PrintSummary(TraceState *pState)
+{
+    OpSummary *pSum;
+    int32_t op;
+
+    printf("\n%llu frames, %llu dropped, %llu failed, %llu truncated\n",
+        (unsigned long long)pState->frames, (unsigned long long)pState->dropped,
+        (unsigned long long)pState->errors, (unsigned long long)pState->truncated);
+    printf("%-16s %10s %12s %12s %12s\n", "operation", "count", "bytes", "avg us", "max us");
+    for (op = 0; op < OP_NUM; op++)
+    {
+        pSum = &pState->sum[op];
+        if (pSum->count == 0)
+        {
+            continue;
+        }
+        printf("%-16s %10llu %12llu %12.3f %12.3f\n", opName[op],
+            (unsigned long long)pSum->count, (unsigned long long)pSum->bytes,
+            (pSum->totalNs / 1000.0) / pSum->count, pSum->maxNs / 1000.0);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    TraceState state;
+    HbiTraceFileHdr hdr;
+    HbiTraceRec rec;
+    FILE *fp;
+    uint32_t i;
+    int opt;
+
+    memset(&state, 0, sizeof(state));
+    state.page = -1;
+
+    while ((opt = getopt(argc, argv, "qh")) != -1)
+    {
+        switch (opt)
+        {
+            case 'q':
+                state.quiet = true;
+                break;
+            default:
+                printf("Usage: %s [-q] <trace file>\n", argv[0]);
+                return (opt == 'h') ? 0 : -1;
+        }
+    }
+    if (optind >= argc)
+    {
+        printf("Usage: %s [-q] <trace file>\n", argv[0]);
+        return -1;
+    }
+
+    fp = fopen(argv[optind], "rb");
+    if (fp == NULL)
+    {
+        printf("Error: can't open %s\n", argv[optind]);
+        return -1;
+    }
+
+    while (fread(&hdr, sizeof(hdr), 1, fp) == 1)
+    {
+        if (memcmp(hdr.magic, HBI_TRACE_MAGIC, sizeof(hdr.magic)) ||
+            (hdr.version != HBI_TRACE_VERSION) || (hdr.recSize != sizeof(HbiTraceRec)))
+        {
+            printf("Error: not a trace file or unsupported version\n");
+            fclose(fp);
+            return -1;
+        }
+        if (hdr.dropped)
+        {
+            state.dropped += hdr.dropped;
+            state.page = -1;
+            state.cmdPending = false;
+            if (!state.quiet)
+            {
+                printf("---- %u frames dropped ----\n", hdr.dropped);
+            }
+        }
+        for (i = 0; i < hdr.count; i++)
+        {
+            if (fread(&rec, sizeof(rec), 1, fp) != 1)
+            {
+                printf("Error: trace file truncated\n");
+                fclose(fp);
+                return -1;
+            }
+            if (state.frames == 0)
+            {
+                state.firstNs = rec.startNs;
+            }
+            state.frames++;
+            DecodeFrame(&state, &rec);
+        }
+    }
+    fclose(fp);
+
+    PrintSummary(&state);
+    return 0;
+}